@@ -1,37 +1,55 @@
 #ifndef FRAME_CONTROL_HPP
 #include <chrono>
+#include <cstdint>
 #include <thread>
 
 namespace easysa {
 	namespace components {
+/*
+* Paces frames against absolute deadlines, the n-th Control() after Start() returns at
+* start + n / frame_rate, so sleep overshoot does not accumulate into drift.
+* Call Start() once before the first frame.
+* Control() sleeps on the calling thread, for a loop that owns its thread anyway. Code that
+* paces many streams takes NextDeadline() instead and waits on a shared timer, as the
+* source module does with its decode scheduler.
+*/
 class FrameController {
 public:
 	explicit FrameController(uint32_t frame_rate) :
 							 frame_rate_(frame_rate){}
-	void Start() { start_ = std::chrono::steady_clock::now(); }
+	void Start() {
+		start_ = std::chrono::steady_clock::now();
+		frames_ = 0;
+	}
 	inline uint32_t GetFrameRate() const { return frame_rate_; }
 	inline void SetFrameRate(uint32_t frame_rate) {
 		frame_rate_ = frame_rate;
+		Start();
+	}
+	std::chrono::steady_clock::time_point NextDeadline() {
+		auto now = std::chrono::steady_clock::now();
+		if (frame_rate_ == 0) return now;
+		++frames_;
+		auto deadline = start_ + Offset(frames_);
+		if (now - deadline > Offset(frame_rate_)) {
+			// more than one second behind, restart instead of bursting to catch up
+			Start();
+			return now;
+		}
+		return deadline;
 	}
 	void Control() {
 		if (frame_rate_ == 0) return;
-		double delay = 1000.0 / frame_rate_;
-		end_ = std::chrono::steady_clock::now();
-		std::chrono::duration<double, std::milli> diff = end_ - start_;
-		auto gap = delay - diff.count() - time_gap_;
-		if (gap > 0) {
-			std::chrono::duration<double, std::milli> dura(gap);
-			std::this_thread::sleep_for(dura);
-			time_gap_ = 0;
-		}
-		else {
-			time_gap_ = -gap;
-		}
+		std::this_thread::sleep_until(NextDeadline());
 	}
 private:
+	std::chrono::steady_clock::duration Offset(uint64_t frames) const {
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::nanoseconds(frames * 1000000000ULL / frame_rate_));
+	}
 	uint32_t frame_rate_{25};
-	double time_gap_ = 0;
-	std::chrono::time_point<std::chrono::steady_clock> start_, end_;
+	uint64_t frames_ = 0;
+	std::chrono::time_point<std::chrono::steady_clock> start_ = std::chrono::steady_clock::now();
 }; // class FrameController
 
 	} // namespace components
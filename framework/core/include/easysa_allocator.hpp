@@ -10,7 +10,9 @@
 #define FRAMEWORK_CORE_INCLUDE_EASYSA_ALLOCATOR_HPP_
 
 #include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <new>
 #include "easysa_common.hpp"
 #include "util/easysa_queue.hpp"
@@ -44,9 +46,82 @@ namespace easysa {
 		void free(void* p) override;
 	};
 
+	/**
+	 * A CPU allocator that keeps freed blocks for reuse.
+	 *
+	 * Requests are rounded up to size classes, four per power of two from 256 B to 64 MiB, so frames
+	 * and tensors of one resolution share a class while wasting at most a quarter. Freed blocks go
+	 * to a small cache of the freeing thread first, then to a central cache shared by all threads;
+	 * the central cache keeps at most max_cached_bytes and frees the rest. Larger requests are not pooled.
+	 * Reclaim(), and alloc() running into max_bytes, also have every thread free its cached blocks on
+	 * its next call to alloc() or free().
+	 * Blocks are 64 byte aligned.
+	 *
+	 * With max_bytes set, alloc() first reclaims cached blocks, then waits up to timeout_ms for other
+	 * threads to free memory, and returns nullptr after that. timeout_ms < 0 waits without limit.
+	 *
+	 * With huge_pages set, blocks of 2 MiB and up are mapped with MAP_HUGETLB, or with transparent huge
+	 * pages (MADV_HUGEPAGE) when no huge pages are reserved, or allocated as usual when neither works.
+	 * Huge pages are used on Linux only. With prefault set, the pages of new blocks are touched before
+	 * alloc() returns, so the decoder writing a frame takes no page faults.
+	 */
+	class PooledCpuAllocator : public MemoryAllocator {
+	public:
+		struct Config {
+			size_t max_bytes = 0;                        ///< Limit of memory held by the pool, 0 means no limit.
+			size_t max_cached_bytes = 256 << 20;         ///< Limit of free blocks kept in the central cache.
+			size_t thread_cache_bytes = 16 << 20;        ///< Limit of free blocks kept per thread.
+			bool huge_pages = false;                     ///< Back large blocks with huge pages when available.
+			bool prefault = false;                       ///< Fault in the pages of new blocks.
+		};
+		struct Stats {
+			size_t total_bytes = 0;   ///< Memory held by the pool, in use or cached.
+			size_t cached_bytes = 0;  ///< Memory of free blocks in the central cache.
+			uint64_t hits = 0;        ///< Allocations served from a cache.
+			uint64_t misses = 0;      ///< Allocations served by the system.
+			size_t huge_bytes = 0;    ///< Memory of blocks mapped with huge pages, reserved or transparent.
+		};
+
+		PooledCpuAllocator();
+		explicit PooledCpuAllocator(const Config& config);
+		~PooledCpuAllocator();
+
+		void* alloc(size_t size, int timeout_ms = 0) override;
+		void free(void* p) override;
+
+		/**
+		 * Frees the blocks of the central cache. Blocks cached by a thread are freed on its next call to
+		 * alloc() or free().
+		 */
+		void Reclaim();
+		/**
+		 * Changes max_bytes and max_cached_bytes of a pool in use. Cached blocks over the new limits are
+		 * freed, and allocations waiting for memory try again.
+		 */
+		void SetLimits(size_t max_bytes, size_t max_cached_bytes);
+		Stats GetStats() const;
+
+		struct State;
+
+	private:
+		std::shared_ptr<State> state_;
+	};
+
 	// helper functions
-	std::shared_ptr<void> MemAlloc(size_t size, std::shared_ptr<MemoryAllocator> allocator);
-	std::shared_ptr<void> CpuMemAlloc(size_t size);
+	/**
+	 * Allocates from allocator, waiting up to timeout_ms for memory when it is bounded, see
+	 * MemoryAllocator::alloc(). Returns nullptr when no memory is left.
+	 */
+	std::shared_ptr<void> MemAlloc(size_t size, std::shared_ptr<MemoryAllocator> allocator, int timeout_ms = 0);
+	/**
+	 * Allocates from the process wide PooledCpuAllocator, see GetCpuMemPool().
+	 */
+	std::shared_ptr<void> CpuMemAlloc(size_t size, int timeout_ms = 0);
+	/**
+	 * Gets the process wide PooledCpuAllocator used by CpuMemAlloc(). It has no thread cache, freed
+	 * blocks go to the central cache at once. It has no limit until one is set with SetLimits().
+	 */
+	std::shared_ptr<PooledCpuAllocator> GetCpuMemPool();
 
 }  // namespace easysa
 
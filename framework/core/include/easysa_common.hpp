@@ -32,6 +32,7 @@ namespace easysa {
         EVENT_EOS,      ///< An EOS event.
         EVENT_STOP,     ///< Stops an event that is called by application layer usually.
         EVENT_STREAM_ERROR,  ///< A stream error event.
+        EVENT_STREAM_CATCHUP,  ///< A source skipped frames to catch up with a lagging stream.
         EVENT_TYPE_END  ///< Reserved for your custom events.
     };
 
@@ -17,6 +17,7 @@
   */
 
 #include <atomic>
+#include <cstdint>
 #include <functional>
 #include <list>
 #include <mutex>
@@ -47,6 +48,8 @@ namespace easysa {
 		std::string message;        ///< Additional event messages.
 		std::string module_name;    ///< The module that posts this event.
 		std::thread::id thread_id;  ///< The thread id from which the event is posted.
+		int64_t pts = -1;           ///< The pts the event refers to, -1 if none.
+		uint64_t count = 0;         ///< A count the event reports, e.g. the packets skipped on EVENT_STREAM_CATCHUP.
 	};
 
 /**
@@ -17,6 +17,7 @@
   */
 #include <opencv2/opencv.hpp>
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -27,6 +28,7 @@
 #include "easysa_allocator.hpp"
 #include "easysa_common.hpp"
 #include "easysa_frame.hpp"
+#include "easysa_infer_table.hpp"
 #include "util/easysa_any.hpp"
 
 
@@ -52,7 +54,8 @@ namespace easysa {
         PIXEL_FORMAT_ARGB32,           ///< This frame is in the ARGB32 format.
         PIXEL_FORMAT_ABGR32,           ///< This frame is in the ABGR32 format.
         PIXEL_FORMAT_RGBA32,           ///< This frame is in the RGBA32 format.
-        PIXEL_FORMAT_BGRA32            ///< This frame is in the BGRA32 format.
+        PIXEL_FORMAT_BGRA32,           ///< This frame is in the BGRA32 format.
+        PIXEL_FORMAT_YUV420_I420       ///< This frame is in the YUV420P(I420) format.
     } DataFormat;
 
     /**
@@ -95,6 +98,8 @@ namespace easysa {
         case PIXEL_FORMAT_YUV420_NV12:
         case PIXEL_FORMAT_YUV420_NV21:
             return 2;
+        case PIXEL_FORMAT_YUV420_I420:
+            return 3;
         default:
             return 0;
         }
@@ -163,56 +168,106 @@ namespace easysa {
     public:
         std::shared_ptr<void> cpu_data = nullptr;  ///< CPU data pointer.
         std::shared_ptr<void> cuda_data = nullptr;  ///< A pointer to the CUDA data.
+
+        /**
+         * The full resolution frame, only set when the source scales frames down and is asked to keep it.
+         * The format is the same as ``fmt``.
+         */
+        int full_width = 0;                            ///< The width of the full resolution frame.
+        int full_height = 0;                           ///< The height of the full resolution frame.
+        int full_stride[MAX_PLANES];                   ///< The strides of the full resolution frame.
+        void* full_ptr_cpu[MAX_PLANES];                ///< The CPU data addresses for full resolution planes.
+        std::shared_ptr<void> full_cpu_data = nullptr;  ///< Holds the full resolution planes.
+        bool HasFullResolution() const { return full_cpu_data != nullptr; }
         // std::unique_ptr<easysa::SyncedMemory> data[MAX_PLANES];  ///< Synchronizes data helper.
     public:
     cv::Mat src_mat;
-  /**
-   * Converts data from RGB to BGR. Called after CopyToSyncMem() is invoked.
-   *
-   * If data is not RGB image but BGR, YUV420NV12 or YUV420NV21 image, its color mode will not be converted.
-   *
-   * @return Returns data with opencv mat type.
-   */
-    cv::Mat* ImageBGR();
-        bool HasBGRImage() {
-            if (bgr_mat) return true;
-            return false;
-        }
+        /**
+         * Gets the frame as a BGR24 image. The conversion runs once per frame, later calls and other
+         * modules share the result, which is released with the frame.
+         *
+         * @return Returns the cached image, or nullptr if the frame has no CPU data or an unsupported format.
+         *
+         * @note This is a thread-safe function. The image is shared, clone it before modifying it.
+         */
+        cv::Mat* ImageBGR();
+        bool HasBGRImage() { return bgr_view_.ready.load(); }
+
+        /**
+         * Gets the frame as a RGB24 image, cached like ImageBGR().
+         */
+        cv::Mat* ImageRGB();
+
+        /**
+         * Gets the frame as planar float, (pixel - mean[c]) / stddev[c] per channel, cached per set of arguments.
+         *
+         * @param rgb Channel order of the planes, RGB if true, else BGR.
+         * @param mean Per channel mean in the plane order, none if empty.
+         * @param stddev Per channel standard deviation in the plane order, none if empty.
+         *
+         * @return Returns a CV_32FC1 mat of 3 * height rows and width cols, the planes one after
+         *         another, or nullptr on failure.
+         *
+         * @note This is a thread-safe function. The mat is shared, clone it before modifying it.
+         */
+        cv::Mat* ImagePlanarFloat(bool rgb = true, const std::vector<float>& mean = {},
+            const std::vector<float>& stddev = {});
+
+        /**
+         * Gets the frame scaled to at least width x height in a packed format, from a per frame cache of levels.
+         * The smallest cached level that is large enough is returned. If there is none, a level of exactly
+         * width x height is made from the nearest larger level, or from the full frame, and cached for the
+         * other modules.
+         *
+         * @param width The minimum width.
+         * @param height The minimum height.
+         * @param fmt The format of the level, PIXEL_FORMAT_BGR24 or PIXEL_FORMAT_RGB24.
+         * @param exact Only a level of exactly width x height is returned, e.g. for a network input.
+         *
+         * @return Returns the cached level, or nullptr on failure. If the frame is smaller than requested
+         *         and exact is false, the full frame is returned.
+         *
+         * @note This is a thread-safe function. The image is shared, clone it before modifying it.
+         */
+        cv::Mat* GetScaledImage(int width, int height, DataFormat fmt = PIXEL_FORMAT_BGR24, bool exact = false);
+
     private:
-        cv::Mat* bgr_mat = nullptr;
+        // a conversion result computed once and shared by all readers of the frame
+        struct CachedView {
+            std::once_flag once;
+            std::atomic<bool> ready{ false };
+            cv::Mat mat;
+            std::shared_ptr<void> buffer;  // holds the pixels of mat unless it refers to the frame
+        };
+        struct FloatView : public CachedView {
+            bool rgb = true;
+            float mean[3] = { 0.f, 0.f, 0.f };
+            float stddev[3] = { 1.f, 1.f, 1.f };
+        };
+        struct ScaledView : public CachedView {
+            int width = 0;
+            int height = 0;
+            DataFormat fmt = PIXEL_FORMAT_BGR24;
+        };
+        cv::Mat* GetView(CachedView* view, bool rgb);
+        bool ConvertColor(CachedView* view, bool rgb);
+        CachedView bgr_view_;
+        CachedView rgb_view_;
+        std::vector<std::shared_ptr<FloatView>> float_views_;
+        std::vector<std::shared_ptr<ScaledView>> scaled_views_;
     private:
         std::mutex mtx;
     };                                 // struct DataFrame
 
     /**
-     * A structure holding the bounding box for detection information of an object.
-     * Normalized coordinates.
-     */
-    struct InferBoundingBox {
-        float x;  ///< The x-axis coordinate in the upper left corner of the bounding box.
-        float y;  ///< The y-axis coordinate in the upper left corner of the bounding box.
-        float w;  ///< The width of the bounding box.
-        float h;  ///< The height of the bounding box.
-    };
-
-    /**
-     * A structure holding the classification properties of an object.
-     */
-    struct InferAttr {
-        int id = -1;      ///< The unique ID of the classification. The value -1 is invalid.
-        int value = -1;   ///< The label value of the classification.
-        float score = 0;  ///< The label score of the classification.
-    };
-
-    /**
-     * The feature value for one object.
+     * All kinds of features for one object.
      */
-    using InferFeature = std::vector<float>;
+    using InferFeatures = std::vector<std::pair<std::string, InferFeature>>;
 
     /**
-     * All kinds of features for one object.
+     * Views of all kinds of features for one object.
      */
-    using InferFeatures = std::vector<std::pair<std::string, InferFeature>>;
+    using InferFeatureSpans = std::vector<std::pair<std::string, FeatureSpan>>;
 
     /**
      * String pairs for extra attributes.
@@ -221,15 +276,51 @@ namespace easysa {
 
     /**
      * A structure holding the information for an object.
+     *
+     * The object is a handle to a row of an InferObjTable: the box, score, class id, track id, attributes
+     * and features are read from and written to the table. Objects of a frame are added with
+     * InferObjs::AddObject(), so the frame keeps them in one table. A default constructed object has a
+     * small table of its own.
      */
     struct InferObject {
     public:
-        std::string id;           ///< The ID of the classification (label value).
-        std::string track_id;     ///< The tracking result.
-        float score;              ///< The label score.
-        InferBoundingBox bbox;  ///< The object normalized coordinates.
+        InferObject();
+        InferObject(std::shared_ptr<InferObjTable> table, size_t row);
+
         std::unordered_map<int, any> datas;  ///< user-defined structured information.
 
+        /**
+         * Gets the object normalized coordinates.
+         *
+         * @note This is a thread-safe function.
+         */
+        InferBoundingBox GetBBox() const;
+        void SetBBox(const InferBoundingBox& bbox);
+
+        /**
+         * Gets the label score.
+         *
+         * @note This is a thread-safe function.
+         */
+        float GetScore() const;
+        void SetScore(float score);
+
+        /**
+         * Gets the ID of the classification (label value), -1 if not classified.
+         *
+         * @note This is a thread-safe function.
+         */
+        int GetClassId() const;
+        void SetClassId(int class_id);
+
+        /**
+         * Gets the tracking result, -1 if not tracked.
+         *
+         * @note This is a thread-safe function.
+         */
+        int64_t GetTrackId() const;
+        void SetTrackId(int64_t track_id);
+
         /**
          * Adds the key of an attribute to a specified object.
          *
@@ -336,40 +427,77 @@ namespace easysa {
          */
         bool AddFeature(const std::string& key, const InferFeature& feature);
 
+        /**
+         * Adds a feature from a buffer, see AddFeature().
+         */
+        bool AddFeature(const std::string& key, const float* data, size_t size);
+
+        /**
+         * Gets an feature by key without copying it.
+         *
+         * @param key The key of an feature you want to query. See AddFeature.
+         *
+         * @return Return a view of the feature, empty if the feature identified by the key does not exist.
+         *         Features are never changed once added, the view can be read without locks while the
+         *         object is alive.
+         *
+         * @note This is a thread-safe function.
+         */
+        FeatureSpan GetFeatureSpan(const std::string& key);
+        FeatureSpan GetFeatureSpan(int key);
+
+        /**
+         * Gets views of all features of an object, see GetFeatureSpan().
+         *
+         * @note This is a thread-safe function.
+         */
+        InferFeatureSpans GetFeatureSpans();
+
         /**
          * Gets an feature by key.
          *
          * @param key The key of an feature you want to query. See AddFeature.
          *
-         * @return Return the feature of the key. If the feature identified by the key
+         * @return Return a copy of the feature of the key. If the feature identified by the key
          *         is not exists, CNInferFeature will be empty.
          *
-         * @note This is a thread-safe function.
+         * @note This is a thread-safe function. Prefer GetFeatureSpan(), which does not copy.
          */
         InferFeature GetFeature(const std::string& key);
 
         /**
          * Gets the features of an object.
          *
-         * @return Returns the features of an object.
+         * @return Returns copies of the features of an object.
          *
-         * @note This is a thread-safe function.
+         * @note This is a thread-safe function. Prefer GetFeatureSpans(), which does not copy.
          */
         InferFeatures GetFeatures();
 
         void* user_data_ = nullptr;  ///< User data. You can store your own data in this parameter.
 
+        InferObjTable* GetTable() const { return table_.get(); }
+        size_t GetRow() const { return row_; }
+
     private:
-        std::unordered_map<std::string, InferAttr> attributes_;
-        std::unordered_map<std::string, std::string> extra_attributes_;
-        std::unordered_map<std::string, InferFeature> features_;
-        std::mutex attribute_mutex_;
-        std::mutex feature_mutex_;
+        std::shared_ptr<InferObjTable> table_;  // kept alive by its objects
+        size_t row_ = 0;
     };
 
     struct InferObjs : public NonCopyable {
         std::vector<std::shared_ptr<InferObject>> objs_;  /// the objects storing inference results
         std::mutex mutex_;   /// mutex of CNInferObjs
+        std::shared_ptr<InferObjTable> table_ = std::make_shared<InferObjTable>();  /// rows of the objects, see AddObject()
+
+        /**
+         * Adds an object as a row of table_ and appends it to objs_.
+         *
+         * @return Returns the object, a handle to its row.
+         *
+         * @note This is a thread-safe function.
+         */
+        std::shared_ptr<InferObject> AddObject(const InferBoundingBox& bbox, float score, int class_id = -1,
+            int64_t track_id = -1);
     };
 
     /**
@@ -0,0 +1,325 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#ifndef FRAMEWORK_CORE_INCLUDE_EASYSA_INFER_TABLE_HPP_
+#define FRAMEWORK_CORE_INCLUDE_EASYSA_INFER_TABLE_HPP_
+
+/**
+ *  @file easysa_infer_table.hpp
+ *
+ *  This file contains a declaration of the InferObjTable, a per frame store of inference results
+ *  laid out as a structure of arrays.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "easysa_common.hpp"
+
+namespace easysa {
+
+    /**
+     * A structure holding the bounding box for detection information of an object.
+     * Normalized coordinates.
+     */
+    struct InferBoundingBox {
+        float x;  ///< The x-axis coordinate in the upper left corner of the bounding box.
+        float y;  ///< The y-axis coordinate in the upper left corner of the bounding box.
+        float w;  ///< The width of the bounding box.
+        float h;  ///< The height of the bounding box.
+    };
+
+    /**
+     * A structure holding the classification properties of an object.
+     */
+    struct InferAttr {
+        int id = -1;      ///< The unique ID of the classification. The value -1 is invalid.
+        int value = -1;   ///< The label value of the classification.
+        float score = 0;  ///< The label score of the classification.
+    };
+
+    /**
+     * The feature value for one object.
+     */
+    using InferFeature = std::vector<float>;
+
+    /**
+     * A read-only view of a feature stored in a FeatureArena. Features are published once and never
+     * change, so a span can be read without locks and stays valid until the InferObjTable that owns the
+     * arena is cleared or destroyed. An InferObject keeps its table alive.
+     */
+    class FeatureSpan {
+    public:
+        FeatureSpan() = default;
+        FeatureSpan(const float* data, size_t size) : data_(data), size_(size) {}
+
+        const float* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const float* begin() const { return data_; }
+        const float* end() const { return data_ + size_; }
+        const float& operator[](size_t i) const { return data_[i]; }
+        /**
+         * Copies the feature, for callers that need to own it.
+         */
+        InferFeature ToVector() const { return data_ ? InferFeature(data_, data_ + size_) : InferFeature(); }
+
+    private:
+        const float* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    /**
+     * Interns the names of attributes and features as small integers, shared by the whole process.
+     * Interning a name once and keeping its key saves hashing the string on every access.
+     */
+    class InferKeys {
+    public:
+        /**
+         * Gets the key of a name, the same name always gets the same key.
+         *
+         * @note This is a thread-safe function.
+         */
+        static int Intern(const std::string& name);
+
+        /**
+         * Gets the key of a name without interning it.
+         *
+         * @return Returns the key, or -1 if the name has never been interned.
+         *
+         * @note This is a thread-safe function.
+         */
+        static int Find(const std::string& name);
+
+        /**
+         * Gets the name of a key, empty for an unknown key.
+         *
+         * @note This is a thread-safe function.
+         */
+        static const std::string& Name(int key);
+    };
+
+    /**
+     * Storage of float features, 64 byte aligned, allocated from large blocks that never move.
+     * Pointers stay valid until Clear() or the arena is destroyed.
+     */
+    class FeatureArena : public NonCopyable {
+    public:
+        static constexpr size_t kAlignment = 64;
+        static constexpr size_t kBlockFloats = 16 * 1024;
+
+        /**
+         * @param first_block_floats Size of the first block, later blocks double up to kBlockFloats.
+         *                           A single object uses a small one, a frame the default.
+         */
+        explicit FeatureArena(size_t first_block_floats = kBlockFloats) : next_block_floats_(first_block_floats) {}
+        ~FeatureArena() = default;
+
+        /**
+         * Allocates room for size floats, aligned to kAlignment. Returns nullptr when out of memory.
+         */
+        float* Allocate(size_t size);
+        void Clear();
+        size_t GetBytes() const { return bytes_; }
+
+    private:
+        struct Block {
+            std::unique_ptr<char[]> raw;
+            float* data = nullptr;
+            size_t capacity = 0;  // in floats
+            size_t used = 0;      // in floats
+        };
+        std::vector<Block> blocks_;
+        size_t bytes_ = 0;
+        size_t next_block_floats_ = kBlockFloats;
+    };
+
+    /**
+     * Inference results of one frame, one row per object.
+     *
+     * Boxes, scores, classes and track ids are kept in contiguous arrays, attributes and features
+     * in flat arrays of entries chained per row, and feature values in one FeatureArena. Adding an
+     * object or a result costs one lock and, most of the time, no allocation. A lookup walks the
+     * entries of its row only.
+     *
+     * InferObject is a handle to a row, see InferObjs::AddObject().
+     *
+     * Keys are interned with InferKeys. The string overloads intern on every call, modules that
+     * run per frame should intern their keys once.
+     *
+     * @note All functions are thread-safe. The column accessors BBoxes(), Scores(), ClassIds() and
+     *       TrackIds() return the arrays themselves, they must not be used while other threads add objects.
+     */
+    class InferObjTable : public NonCopyable {
+    public:
+        /**
+         * @param first_block_floats Size of the first block of the feature arena, see FeatureArena.
+         */
+        explicit InferObjTable(size_t first_block_floats = FeatureArena::kBlockFloats) : arena_(first_block_floats) {}
+        ~InferObjTable() = default;
+
+        /**
+         * Reserves room for objects, e.g. the max detections of a model.
+         */
+        void Reserve(size_t objects);
+
+        /**
+         * Adds an object.
+         *
+         * @return Returns the row of the object.
+         */
+        size_t AddObject(const InferBoundingBox& bbox, float score, int class_id = -1, int64_t track_id = -1);
+
+        size_t Size() const;
+        void Clear();
+
+        InferBoundingBox GetBBox(size_t row) const;
+        float GetScore(size_t row) const;
+        int GetClassId(size_t row) const;
+        int64_t GetTrackId(size_t row) const;
+        bool SetBBox(size_t row, const InferBoundingBox& bbox);
+        bool SetScore(size_t row, float score);
+        bool SetClassId(size_t row, int class_id);
+        bool SetTrackId(size_t row, int64_t track_id);
+
+        const std::vector<InferBoundingBox>& BBoxes() const { return bboxes_; }
+        const std::vector<float>& Scores() const { return scores_; }
+        const std::vector<int>& ClassIds() const { return class_ids_; }
+        const std::vector<int64_t>& TrackIds() const { return track_ids_; }
+
+        /**
+         * Adds an attribute to an object.
+         *
+         * @return Returns false if the row is invalid or the object already has the attribute.
+         */
+        bool AddAttribute(size_t row, int key, const InferAttr& value);
+        bool AddAttribute(size_t row, const std::string& key, const InferAttr& value) {
+            return AddAttribute(row, InferKeys::Intern(key), value);
+        }
+
+        /**
+         * Gets an attribute of an object. If the attribute does not exist, InferAttr::id is -1.
+         */
+        InferAttr GetAttribute(size_t row, int key) const;
+        InferAttr GetAttribute(size_t row, const std::string& key) const {
+            return GetAttribute(row, InferKeys::Find(key));
+        }
+
+        /**
+         * Adds an extended attribute to an object.
+         *
+         * @return Returns false if the row is invalid or the object already has the attribute.
+         */
+        bool AddExtraAttribute(size_t row, int key, const std::string& value);
+        bool AddExtraAttribute(size_t row, const std::string& key, const std::string& value) {
+            return AddExtraAttribute(row, InferKeys::Intern(key), value);
+        }
+
+        /**
+         * Gets an extended attribute of an object, empty if it does not exist.
+         */
+        std::string GetExtraAttribute(size_t row, int key) const;
+        std::string GetExtraAttribute(size_t row, const std::string& key) const {
+            return GetExtraAttribute(row, InferKeys::Find(key));
+        }
+
+        /**
+         * Removes an extended attribute of an object.
+         *
+         * @return Returns false if the object does not have the attribute.
+         */
+        bool RemoveExtraAttribute(size_t row, int key);
+
+        /**
+         * Gets all extended attributes of an object in the order they were added.
+         */
+        std::vector<std::pair<int, std::string>> GetExtraAttributes(size_t row) const;
+
+        /**
+         * Adds a feature to an object, the values are copied to the arena.
+         *
+         * @return Returns false if the row is invalid, the object already has the feature or out of memory.
+         */
+        bool AddFeature(size_t row, int key, const float* data, size_t size);
+        bool AddFeature(size_t row, int key, const InferFeature& feature) {
+            return AddFeature(row, key, feature.data(), feature.size());
+        }
+        bool AddFeature(size_t row, const std::string& key, const InferFeature& feature) {
+            return AddFeature(row, InferKeys::Intern(key), feature.data(), feature.size());
+        }
+
+        /**
+         * Gets a feature of an object without copying it, empty if it does not exist.
+         */
+        FeatureSpan GetFeatureSpan(size_t row, int key) const;
+        FeatureSpan GetFeatureSpan(size_t row, const std::string& key) const {
+            return GetFeatureSpan(row, InferKeys::Find(key));
+        }
+
+        /**
+         * Gets all features of an object without copying them, in the order they were added.
+         */
+        std::vector<std::pair<int, FeatureSpan>> GetFeatureSpans(size_t row) const;
+
+        /**
+         * Gets a copy of a feature of an object, empty if it does not exist.
+         */
+        InferFeature GetFeature(size_t row, int key) const;
+        InferFeature GetFeature(size_t row, const std::string& key) const {
+            return GetFeature(row, InferKeys::Find(key));
+        }
+
+    private:
+        static constexpr uint32_t kNoEntry = UINT32_MAX;
+        // entries of a row are chained from the newest, next is the index of the one added before
+        struct AttrEntry {
+            int key;
+            uint32_t next;
+            InferAttr value;
+        };
+        struct ExtraEntry {
+            int key;
+            uint32_t next;
+            std::string value;
+        };
+        struct FeatureEntry {
+            int key;
+            uint32_t next;
+            FeatureSpan span;
+        };
+        struct RowHeads {
+            uint32_t attributes = kNoEntry;
+            uint32_t extra_attributes = kNoEntry;
+            uint32_t features = kNoEntry;
+        };
+        template <typename Entry>
+        static uint32_t FindEntry(const std::vector<Entry>& entries, uint32_t head, int key);
+        template <typename Entry>
+        static void PushEntry(std::vector<Entry>* entries, uint32_t* head, Entry entry);
+
+        mutable std::mutex mutex_;
+        std::vector<InferBoundingBox> bboxes_;
+        std::vector<float> scores_;
+        std::vector<int> class_ids_;
+        std::vector<int64_t> track_ids_;
+        std::vector<RowHeads> heads_;
+        std::vector<AttrEntry> attributes_;
+        std::vector<ExtraEntry> extra_attributes_;
+        std::vector<FeatureEntry> features_;
+        FeatureArena arena_;
+    };
+
+}  // namespace easysa
+
+#endif  // FRAMEWORK_CORE_INCLUDE_EASYSA_INFER_TABLE_HPP_
@@ -48,6 +48,7 @@ namespace easysa {
         ERROR_MSG,       ///< An error message. The stream process has failed in one of the modules.
         STREAM_ERR_MSG,  ///< Stream error message, stream process failed at source.
         FRAME_ERR_MSG,   ///< Frame error message, frame decode failed at source.
+        STREAM_CATCHUP_MSG,  ///< Stream catch-up message, the source skipped frames because the pipeline lagged.
         USER_MSG0 = 32,  ///< Reserved message. You can define your own messages.
         USER_MSG1,       ///< Reserved message. You can define your own messages.
         USER_MSG2,       ///< Reserved message. You can define your own messages.
@@ -70,6 +71,7 @@ namespace easysa {
         std::string stream_id;    ///< Stream id, set by user in FrameINfo::stream_id.
         std::string module_name;  ///< The module that posts this event.
         int64_t pts = -1;  ///< The pts of this frame.
+        uint64_t skipped_packets = 0;  ///< The packets skipped, for STREAM_CATCHUP_MSG, which resumes at pts.
     };
 
     /**
@@ -364,6 +366,16 @@ namespace easysa {
          */
         StreamMsgObserver* GetStreamMsgObserver() const;
 
+        /**
+         * Gets the timestamp of the last frame of a stream that has been processed by all modules.
+         * Used by sources to measure how far the pipeline lags behind.
+         *
+         * @param stream_id The stream id.
+         *
+         * @return Returns the timestamp, or -1 if no frame of the stream has been output yet.
+         */
+        int64_t GetStreamOutputTimestamp(const std::string& stream_id);
+
         /** profiler **/
         PipelineProfiler* GetProfiler() const;
 
@@ -475,6 +487,8 @@ namespace easysa {
         EventBus* event_bus_ = nullptr;
         IdxManager* idxManager_ = nullptr;
         std::function<void(std::shared_ptr<FrameInfo>)> frame_done_callback_ = nullptr;
+        std::mutex output_ts_mtx_;
+        std::unordered_map<std::string, int64_t> output_ts_;  ///< last output timestamp of each stream
 
         ThreadSafeQueue<StreamMsg> msgq_;
         std::thread smsg_thread_;
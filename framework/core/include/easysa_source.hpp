@@ -24,6 +24,7 @@
 #include <atomic>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <mutex>
@@ -44,6 +45,12 @@ namespace easysa {
 	public:
 		explicit SourceModule(const std::string& name) : Module(name) { has_transmit_.store(1); }
 		bool AddSource(std::shared_ptr<SourceHandler> handler);
+		/*
+		* Opens the handlers concurrently, at most max_concurrency at a time (0 means hardware threads).
+		* @return one result per handler, in the same order, true if the source was added.
+		*/
+		std::vector<bool> AddSources(const std::vector<std::shared_ptr<SourceHandler>>& handlers,
+			uint32_t max_concurrency = 0);
 		int RemoveSource(std::shared_ptr<SourceHandler> handler, bool force);
 		int RemoveSource(const std::string& stream_id, bool force_remove = false);
 		std::shared_ptr<SourceHandler> GetSourceHandler(const std::string& stream_id);
@@ -63,6 +70,9 @@ namespace easysa {
 		uint64_t source_idx_ = 0;
 		std::mutex mtx_;
 		std::unordered_map<std::string /* stream_id*/, std::shared_ptr<SourceHandler>> source_map_;
+		std::unordered_set<std::string /* stream_id*/> pending_;  // reserved while the handler opens
+		// pending streams removed while opening, with force_remove; AddSource closes and rejects them
+		std::unordered_map<std::string /* stream_id*/, bool> removed_pending_;
 
 	}; // class SourceModule
 
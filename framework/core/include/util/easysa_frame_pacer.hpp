@@ -0,0 +1,84 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#ifndef FRAMEWORK_CORE_INCLUDE_UTIL_EASYSA_FRAME_PACER_HPP_
+#define FRAMEWORK_CORE_INCLUDE_UTIL_EASYSA_FRAME_PACER_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace easysa {
+
+    /**
+     * Paces a stream of frames against absolute deadlines.
+     *
+     * The n-th frame after Start() is due at start + n / frame_rate. Deadlines are computed
+     * from the start point instead of the previous frame, so a late wake-up delays only that
+     * frame and sleep overshoot does not accumulate. A stream that falls behind by more than
+     * one second of frames is restarted from now rather than bursting to catch up.
+     */
+    class FramePacer {
+    public:
+        using clock = std::chrono::steady_clock;
+        using time_point = clock::time_point;
+
+        explicit FramePacer(uint32_t frame_rate = 0) : frame_rate_(frame_rate) {}
+
+        void Start() {
+            start_ = clock::now();
+            frames_ = 0;
+        }
+
+        /**
+         * Deadline of the next frame. Callers that wait by other means, e.g. the timer
+         * wheel of a shared scheduler, use this instead of Wait().
+         */
+        time_point NextDeadline() {
+            if (0 == frame_rate_) return clock::now();
+            ++frames_;
+            time_point deadline = start_ + Offset(frames_);
+            time_point now = clock::now();
+            if (now - deadline > Offset(frame_rate_)) {
+                start_ = now;
+                frames_ = 0;
+                return now;
+            }
+            return deadline;
+        }
+
+        /**
+         * Blocks until the deadline of the next frame.
+         */
+        void Wait() {
+            if (0 == frame_rate_) return;
+            std::this_thread::sleep_until(NextDeadline());
+        }
+
+        inline uint32_t GetFrameRate() const { return frame_rate_; }
+        inline void SetFrameRate(uint32_t frame_rate) {
+            // deadlines of the new rate count from now
+            frame_rate_ = frame_rate;
+            Start();
+        }
+
+    private:
+        clock::duration Offset(uint64_t frames) const {
+            return std::chrono::duration_cast<clock::duration>(
+                std::chrono::nanoseconds(frames * 1000000000ULL / frame_rate_));
+        }
+
+        uint32_t frame_rate_ = 0;
+        uint64_t frames_ = 0;
+        time_point start_ = clock::now();
+    };
+
+}  // namespace easysa
+
+#endif  // FRAMEWORK_CORE_INCLUDE_UTIL_EASYSA_FRAME_PACER_HPP_
@@ -68,16 +68,20 @@
  * --------------
  *
  * Internally, a std::vector is used to store timeout events. The timer_id
- * returned from the `add` functions are used as index to this vector.
+ * returned from the `add` functions are used as index to this vector. Ids that
+ * are freed are kept on a stack to be re-used.
  *
- * In addition, a std::multiset is used that holds all time points when
- * timeouts expire.
+ * Pending timeouts are kept in a hierarchical timing wheel: 4 levels of 256
+ * slots, level n holding the timeouts due within 256^(n+1) ticks. Each slot is
+ * an intrusive doubly linked list threaded through the events, so adding and
+ * removing a timeout are O(1). A timeout is moved down one level when the
+ * lower level wraps, and all timeouts of a tick expire as one batch. Timeouts
+ * are rounded up to the tick, 1 ms by default.
  *
- * Using a vector to store timeout events has some implications. It is very
- * fast to remove an event, because the timer_id is the vector's index. On the
- * other hand, this makes it also more complicated to manage the timer_ids. The
- * current solution is to keep track of ids that are freed in order to re-use
- * them. A stack is used for this.
+ * Handlers run on a pool of worker threads, one by default, so that slow
+ * handlers do not delay the wheel. With more than one worker, handlers of
+ * different timeouts and successive runs of a periodic timeout whose handler
+ * is slower than its period may run concurrently.
  *
  * Examples
  * --------
@@ -85,8 +89,8 @@
  * More examples can be found in the `tests` folder.
  *
  * ~~~
- * CppTime::Timer t;
- * t.add(std::chrono::seconds(1), [](CppTime::timer_id){ std::cout << "got it!"; });
+ * easysa::TimerWheel t;
+ * t.add(std::chrono::seconds(1), [](easysa::TimerWheel::timer_id){ std::cout << "got it!"; });
  * std::this_thread::sleep_for(std::chrono::seconds(2));
  * ~~~
  */
@@ -94,9 +98,11 @@
 #include <algorithm>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <set>
 #include <stack>
 #include <thread>
 #include <utility>
@@ -104,45 +110,68 @@
 
 namespace /*CppTime*/ easysa {
 
-    // Public types
-    using timer_id = std::size_t;
-    using handler_t = std::function<void(timer_id)>;
-    using clock = std::chrono::steady_clock;
-    using timestamp = std::chrono::time_point<clock>;
-    using duration = std::chrono::microseconds;
-
     // Private definitions. Do not rely on this namespace.
-    namespace detail {
+    namespace timer_detail {
+
+        // kept out of namespace easysa, whose headers use std::chrono::duration unqualified
+        using timer_id = std::size_t;
+        using handler_t = std::function<void(timer_id)>;
+        using clock = std::chrono::steady_clock;
+        using timestamp = std::chrono::time_point<clock>;
+        using duration = std::chrono::microseconds;
+
+        constexpr timer_id kNoTimer = static_cast<timer_id>(-1);
+        constexpr int kWheelBits = 8;
+        constexpr int kWheelSlots = 1 << kWheelBits;
+        constexpr int kWheelLevels = 4;
 
         // The event structure that holds the information about a timer.
         struct Event {
             timer_id id;
             timestamp start;
             duration period;
-            handler_t handler;
+            std::shared_ptr<handler_t> handler;
             bool valid;
+            // bumped whenever the id is given to a new timeout, tells expired items of an old one apart
+            uint64_t generation = 0;
+            // position in the wheel, slot is -1 when not in the wheel
+            uint64_t expire = 0;
+            int slot = -1;
+            timer_id prev = kNoTimer;
+            timer_id next = kNoTimer;
             Event() : id(0), start(duration::zero()), period(duration::zero()), handler(nullptr), valid(false) {}
             template <typename Func>
             Event(timer_id id, timestamp start, duration period, Func&& handler)
-                : id(id), start(start), period(period), handler(std::forward<Func>(handler)), valid(true) {}
+                : id(id), start(start), period(period),
+                handler(std::make_shared<handler_t>(std::forward<Func>(handler))), valid(true) {}
             Event(Event&& r) = default;
             Event& operator=(Event&& ev) = default;
             Event(const Event& r) = delete;
             Event& operator=(const Event& r) = delete;
         };
 
-        // A time event structure that holds the next timeout and a reference to its
-        // Event struct.
-        struct Time_event {
-            timestamp next;
-            timer_id ref;
+        // An expired timeout waiting for a worker.
+        struct Expired {
+            timer_id id;
+            uint64_t generation;
+            std::shared_ptr<handler_t> handler;
+            bool one_shot;
         };
 
-        inline bool operator<(const Time_event& l, const Time_event& r) { return l.next < r.next; }
+    }  // end namespace timer_detail
 
-    }  // end namespace detail
+    /**
+     * Named TimerWheel, easysa_time_utility.hpp has a Timer of its own.
+     */
+    class TimerWheel {
+    public:
+        using timer_id = timer_detail::timer_id;
+        using handler_t = timer_detail::handler_t;
+        using clock = timer_detail::clock;
+        using timestamp = timer_detail::timestamp;
+        using duration = timer_detail::duration;
 
-    class Timer {
+    private:
         using scoped_m = std::unique_lock<std::mutex>;
 
         // Thread and locking variables.
@@ -154,28 +183,58 @@ namespace /*CppTime*/ easysa {
         bool done = false;
 
         // The vector that holds all active events.
-        std::vector<detail::Event> events;
-        // Sorted queue that has the next timeout at its top.
-        std::multiset<detail::Time_event> time_events;
+        std::vector<timer_detail::Event> events;
 
         // A list of ids to be re-used. If possible, ids are used from this pool.
-        std::stack<cnstream::timer_id> free_ids;
+        std::stack<timer_id> free_ids;
+
+        // The timing wheel, heads of the slot lists of all levels, and the last tick processed.
+        duration tick;
+        timestamp origin;
+        uint64_t current = 0;
+        size_t pending = 0;
+        std::vector<timer_id> slots;
+
+        // Workers running the handlers of expired timeouts.
+        std::mutex pool_m;
+        std::condition_variable pool_cond;
+        std::deque<timer_detail::Expired> expired;
+        std::vector<std::thread> pool;
+        bool pool_done = false;
 
     public:
-        Timer() : m{}, cond{}, worker{}, events{}, time_events{}, free_ids{} {
+        /**
+         * \param worker_num The number of threads running handlers, at least one.
+         * \param resolution The tick of the wheel, timeouts are rounded up to it.
+         */
+        explicit TimerWheel(size_t worker_num = 1, const duration& resolution = std::chrono::milliseconds(1))
+            : m{}, cond{}, worker{}, events{}, free_ids{},
+            tick(resolution.count() > 0 ? resolution : duration(1)), origin(clock::now()),
+            slots(timer_detail::kWheelLevels * timer_detail::kWheelSlots, timer_detail::kNoTimer) {
             scoped_m lock(m);
             done = false;
+            for (size_t i = 0; i < std::max<size_t>(worker_num, 1); ++i) {
+                pool.emplace_back([this] { work(); });
+            }
             worker = std::thread([this] { run(); });
         }
 
-        ~Timer() {
+        ~TimerWheel() {
             scoped_m lock(m);
             done = true;
             lock.unlock();
             cond.notify_all();
             worker.join();
+            {
+                std::lock_guard<std::mutex> pool_lock(pool_m);
+                pool_done = true;
+                expired.clear();
+            }
+            pool_cond.notify_all();
+            for (auto& th : pool) {
+                th.join();
+            }
             events.clear();
-            time_events.clear();
             while (!free_ids.empty()) {
                 free_ids.pop();
             }
@@ -195,18 +254,24 @@ namespace /*CppTime*/ easysa {
             // a new one.
             if (free_ids.empty()) {
                 id = events.size();
-                detail::Event e(id, when, period, std::move(handler));
+                timer_detail::Event e(id, when, period, std::move(handler));
                 events.push_back(std::move(e));
             }
             else {
                 id = free_ids.top();
                 free_ids.pop();
-                detail::Event e(id, when, period, std::move(handler));
+                timer_detail::Event e(id, when, period, std::move(handler));
+                e.generation = events[id].generation + 1;
                 events[id] = std::move(e);
             }
-            time_events.insert(detail::Time_event{ when, id });
+            if (pending == 0) {
+                // the wheel stood still while empty, nothing in between is left to process
+                current = std::max(current, elapsed());
+            }
+            bool wake = schedule(id) || pending == 1;
             lock.unlock();
-            cond.notify_all();
+            // the wheel thread sleeps until the next due slot, wake it only if this one is earlier
+            if (wake) cond.notify_all();
             return id;
         }
 
@@ -229,65 +294,207 @@ namespace /*CppTime*/ easysa {
         }
 
         /**
-         * Removes the timer with the given id.
+         * Removes the timer with the given id. A timeout that already expired but whose handler
+         * has not started yet is dropped. A handler that is already running is not interrupted.
          */
         bool remove(timer_id id) {
             scoped_m lock(m);
-            if (events.size() == 0 || events.size() < id) {
+            if (events.size() == 0 || events.size() <= id) {
+                return false;
+            }
+            timer_detail::Event& ev = events[id];
+            if (!ev.valid) {
                 return false;
             }
-            events[id].valid = false;
-            auto it = std::find_if(time_events.begin(), time_events.end(),
-                [&](const detail::Time_event& te) { return te.ref == id; });
-            if (it != time_events.end()) {
-                free_ids.push(it->ref);
-                time_events.erase(it);
+            ev.valid = false;
+            if (ev.slot >= 0) {
+                unlink(id);
+                free_ids.push(id);
             }
-            lock.unlock();
-            cond.notify_all();
+            // else the one-shot timeout expired, the id is freed once a worker takes it
             return true;
         }
 
     private:
+        uint64_t elapsed() const {
+            return static_cast<uint64_t>((clock::now() - origin) / tick);
+        }
+
+        uint64_t to_tick(const timestamp& when) const {
+            if (when <= origin) return 0;
+            // rounded up, a timeout never fires early
+            return static_cast<uint64_t>((when - origin + tick - clock::duration(1)) / tick);
+        }
+
+        void link(timer_id id, int slot) {
+            timer_detail::Event& ev = events[id];
+            ev.slot = slot;
+            ev.prev = timer_detail::kNoTimer;
+            ev.next = slots[slot];
+            if (ev.next != timer_detail::kNoTimer) events[ev.next].prev = id;
+            slots[slot] = id;
+            ++pending;
+        }
+
+        void unlink(timer_id id) {
+            timer_detail::Event& ev = events[id];
+            if (ev.prev != timer_detail::kNoTimer) {
+                events[ev.prev].next = ev.next;
+            }
+            else {
+                slots[ev.slot] = ev.next;
+            }
+            if (ev.next != timer_detail::kNoTimer) events[ev.next].prev = ev.prev;
+            ev.slot = -1;
+            ev.prev = ev.next = timer_detail::kNoTimer;
+            --pending;
+        }
+
+        // Puts the event in the wheel by its start time. Returns true when it is due before
+        // every other pending timeout of the wheel's lowest level.
+        bool schedule(timer_id id) {
+            timer_detail::Event& ev = events[id];
+            ev.expire = std::max(to_tick(ev.start), current + 1);
+            place(id);
+            return ev.slot < timer_detail::kWheelSlots;
+        }
+
+        void place(timer_id id) {
+            uint64_t expire = events[id].expire;
+            uint64_t delta = expire - current;
+            int level = 0;
+            while (level < timer_detail::kWheelLevels - 1 &&
+                delta >= (uint64_t(1) << (timer_detail::kWheelBits * (level + 1)))) {
+                ++level;
+            }
+            uint64_t at = expire;
+            uint64_t span = uint64_t(1) << (timer_detail::kWheelBits * timer_detail::kWheelLevels);
+            if (delta >= span) {
+                // beyond the wheel, parked in the farthest slot and placed again when it cascades
+                at = current + span - 1;
+            }
+            int index = static_cast<int>((at >> (timer_detail::kWheelBits * level)) & (timer_detail::kWheelSlots - 1));
+            link(id, level * timer_detail::kWheelSlots + index);
+        }
+
+        // Moves the timeouts of a higher level slot down to the lower levels.
+        void cascade(int level) {
+            int index = static_cast<int>((current >> (timer_detail::kWheelBits * level)) & (timer_detail::kWheelSlots - 1));
+            int slot = level * timer_detail::kWheelSlots + index;
+            timer_id id = slots[slot];
+            while (id != timer_detail::kNoTimer) {
+                timer_id next = events[id].next;
+                unlink(id);
+                place(id);
+                id = next;
+            }
+        }
+
+        // Advances the wheel by one tick, collecting the timeouts that expire in it.
+        void advance(std::vector<timer_detail::Expired>* batch) {
+            ++current;
+            for (int level = timer_detail::kWheelLevels - 1; level > 0; --level) {
+                // a level cascades when all the levels below it wrap
+                if ((current & ((uint64_t(1) << (timer_detail::kWheelBits * level)) - 1)) == 0) {
+                    cascade(level);
+                }
+            }
+            int slot = static_cast<int>(current & (timer_detail::kWheelSlots - 1));
+            timer_id id = slots[slot];
+            while (id != timer_detail::kNoTimer) {
+                timer_id next = events[id].next;
+                unlink(id);
+                timer_detail::Event& ev = events[id];
+                bool one_shot = ev.period.count() <= 0;
+                batch->push_back(timer_detail::Expired{ id, ev.generation, ev.handler, one_shot });
+                if (!one_shot) {
+                    // the next timeout counts from the start, periodic timeouts do not drift
+                    ev.start += ev.period;
+                    schedule(id);
+                }
+                id = next;
+            }
+        }
+
+        // Time of the next tick that has work, either a due slot or a cascade.
+        timestamp next_wakeup() const {
+            for (uint64_t t = current + 1; t <= current + timer_detail::kWheelSlots; ++t) {
+                if (slots[t & (timer_detail::kWheelSlots - 1)] != timer_detail::kNoTimer ||
+                    (t & (timer_detail::kWheelSlots - 1)) == 0) {
+                    return origin + tick * t;
+                }
+            }
+            return origin + tick * (current + timer_detail::kWheelSlots);
+        }
+
         void run() {
             scoped_m lock(m);
+            std::vector<timer_detail::Expired> batch;
 
             while (!done) {
-                if (time_events.empty()) {
+                if (pending == 0) {
                     // Wait for work
                     cond.wait(lock);
+                    continue;
+                }
+                uint64_t now = elapsed();
+                while (current < now) {
+                    advance(&batch);
+                }
+                if (!batch.empty()) {
+                    dispatch(&batch);
+                    continue;
+                }
+                cond.wait_until(lock, next_wakeup());
+            }
+        }
+
+        void dispatch(std::vector<timer_detail::Expired>* batch) {
+            {
+                std::lock_guard<std::mutex> pool_lock(pool_m);
+                for (auto& item : *batch) {
+                    expired.push_back(std::move(item));
+                }
+            }
+            if (batch->size() > 1) {
+                pool_cond.notify_all();
+            }
+            else {
+                pool_cond.notify_one();
+            }
+            batch->clear();
+        }
+
+        void work() {
+            std::unique_lock<std::mutex> pool_lock(pool_m);
+            while (true) {
+                pool_cond.wait(pool_lock, [this] { return pool_done || !expired.empty(); });
+                if (pool_done) return;
+                timer_detail::Expired item = std::move(expired.front());
+                expired.pop_front();
+                pool_lock.unlock();
+
+                bool active = false;
+                {
+                    // a removed periodic timeout may have given its id to a new one already
+                    scoped_m lock(m);
+                    const timer_detail::Event& ev = events[item.id];
+                    active = ev.valid && ev.generation == item.generation;
                 }
-                else {
-                    detail::Time_event te = *time_events.begin();
-                    if (cnstream::clock::now() >= te.next) {
-                        // Remove time event
-                        time_events.erase(time_events.begin());
-
-                        // Invoke the handler
-                        lock.unlock();
-                        events[te.ref].handler(te.ref);
-                        lock.lock();
-
-                        if (events[te.ref].valid && events[te.ref].period.count() > 0) {
-                            // The event is valid and a periodic timer.
-                            te.next += events[te.ref].period;
-                            time_events.insert(te);
-                        }
-                        else {
-                            // The event is either no longer valid because it was removed in the
-                            // callback, or it is a one-shot timer.
-                            events[te.ref].valid = false;
-                            free_ids.push(te.ref);
-                        }
-                    }
-                    else {
-                        cond.wait_until(lock, te.next);
-                    }
+                // Invoke the handler
+                if (active) (*item.handler)(item.id);
+                if (item.one_shot) {
+                    // The one-shot timeout is finished, its id may be re-used.
+                    scoped_m lock(m);
+                    events[item.id].valid = false;
+                    free_ids.push(item.id);
                 }
+
+                pool_lock.lock();
             }
         }
     };
 
 }  // namespace easysa
 
-#endif // FRAMEWORK_CORE_INCLUDE_UTIL_EASYSA_TIMER_HPP_
\ No newline at end of file
+#endif // FRAMEWORK_CORE_INCLUDE_UTIL_EASYSA_TIMER_HPP_
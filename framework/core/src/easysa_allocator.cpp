@@ -9,8 +9,19 @@
  *************************************************************************/
 #include "easysa_allocator.hpp"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <exception>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <glog/logging.h>
 
 namespace easysa {
 
@@ -27,17 +38,29 @@ namespace easysa {
         std::shared_ptr<MemoryAllocator> allocator_;
     };
 
-    std::shared_ptr<void> MemAlloc(size_t size, std::shared_ptr<MemoryAllocator> allocator) {
+    std::shared_ptr<void> MemAlloc(size_t size, std::shared_ptr<MemoryAllocator> allocator, int timeout_ms) {
         if (allocator) {
-            std::shared_ptr<void> ds(allocator->alloc(size), AllocDeleter(allocator));
+            void* p = allocator->alloc(size, timeout_ms);
+            if (!p) return nullptr;
+            std::shared_ptr<void> ds(p, AllocDeleter(allocator));
             return ds;
         }
         return nullptr;
     }
 
-    std::shared_ptr<void> CpuMemAlloc(size_t size) {
-        std::shared_ptr<MemoryAllocator> allocator = std::make_shared<CpuAllocator>();
-        return MemAlloc(size, allocator);
+    std::shared_ptr<void> CpuMemAlloc(size_t size, int timeout_ms) {
+        return MemAlloc(size, GetCpuMemPool(), timeout_ms);
+    }
+
+    std::shared_ptr<PooledCpuAllocator> GetCpuMemPool() {
+        // buffers are mostly freed by other threads than the one allocating them, a thread cache
+        // would only hold memory out of reach of the allocating threads
+        static std::shared_ptr<PooledCpuAllocator> pool = []() {
+            PooledCpuAllocator::Config config;
+            config.thread_cache_bytes = 0;
+            return std::make_shared<PooledCpuAllocator>(config);
+        }();
+        return pool;
     }
 
     // cpu Var-size allocator
@@ -52,4 +75,396 @@ namespace easysa {
         delete[]ptr;
     };
 
-}  // namespace easysa
\ No newline at end of file
+    // pooled cpu allocator
+    namespace {
+        constexpr size_t kMinClassSize = 256;
+        constexpr size_t kMaxClassSize = 64 << 20;
+        constexpr size_t kBlockAlignment = 64;
+        constexpr uint32_t kUnpooled = UINT32_MAX;
+        constexpr size_t kPageSize = 4096;
+        constexpr size_t kHugePageSize = 2 << 20;
+
+        enum BlockKind : uint32_t {
+            BLOCK_HEAP = 0,  // operator new
+            BLOCK_MAPPED,    // mmap, huge pages
+        };
+
+        // in front of every block, keeps the user pointer aligned
+        struct alignas(kBlockAlignment) BlockHeader {
+            uint32_t size_class;
+            uint32_t kind;
+            size_t bytes;   // of the block, header included
+            size_t mapped;  // length of the mapping of BLOCK_MAPPED
+        };
+
+        // block sizes, header included: 256, 320, 384, 448, 512, 640, ... up to kMaxClassSize.
+        // From 2 MiB on every other class is a whole number of huge pages.
+        const std::vector<size_t>& ClassSizes() {
+            static const std::vector<size_t> sizes = []() {
+                std::vector<size_t> v;
+                for (size_t base = kMinClassSize; base < kMaxClassSize; base *= 2) {
+                    for (size_t quarter = 0; quarter < 4; ++quarter) {
+                        v.push_back(base + base / 4 * quarter);
+                    }
+                }
+                v.push_back(kMaxClassSize);
+                return v;
+            }();
+            return sizes;
+        }
+
+        uint32_t ClassOf(size_t size) {
+            const std::vector<size_t>& sizes = ClassSizes();
+            if (size > kMaxClassSize) return kUnpooled;
+            return static_cast<uint32_t>(std::lower_bound(sizes.begin(), sizes.end(), size) - sizes.begin());
+        }
+
+        // writes one byte per page, the first write to a page takes the fault
+        void Prefault(void* ptr, size_t bytes) {
+            volatile uint8_t* data = static_cast<volatile uint8_t*>(ptr);
+            for (size_t offset = 0; offset < bytes; offset += kPageSize) data[offset] = 0;
+        }
+
+#ifdef __linux__
+        // maps bytes rounded up to huge pages: reserved huge pages first, then transparent ones
+        void* MapHuge(size_t bytes, bool prefault, size_t* mapped) {
+            *mapped = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (prefault ? MAP_POPULATE : 0);
+            void* raw = mmap(nullptr, *mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (raw != MAP_FAILED) return raw;
+
+            static std::once_flag warned;
+            std::call_once(warned, []() {
+                LOG(WARNING) << "[core]:" << "no reserved huge pages, falling back to transparent huge pages";
+            });
+            // transparent huge pages only back 2 MiB aligned ranges, map more and trim
+            raw = mmap(nullptr, *mapped + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) return nullptr;
+            uintptr_t addr = reinterpret_cast<uintptr_t>(raw);
+            uintptr_t aligned = (addr + kHugePageSize - 1) & ~(uintptr_t)(kHugePageSize - 1);
+            if (aligned > addr) munmap(raw, aligned - addr);
+            if (addr + kHugePageSize > aligned) {
+                munmap(reinterpret_cast<void*>(aligned + *mapped), addr + kHugePageSize - aligned);
+            }
+            raw = reinterpret_cast<void*>(aligned);
+            if (madvise(raw, *mapped, MADV_HUGEPAGE) != 0) {
+                static std::once_flag thp_warned;
+                std::call_once(thp_warned, []() {
+                    LOG(WARNING) << "[core]:" << "transparent huge pages unavailable, using normal pages";
+                });
+            }
+            // after madvise, so the faults are served with huge pages
+            if (prefault) Prefault(raw, *mapped);
+            return raw;
+        }
+#endif
+
+        BlockHeader* AllocBlock(uint32_t size_class, size_t bytes, const PooledCpuAllocator::Config& config) {
+            void* raw = nullptr;
+            uint32_t kind = BLOCK_HEAP;
+            size_t mapped = 0;
+#ifdef __linux__
+            if (config.huge_pages && bytes >= kHugePageSize) {
+                raw = MapHuge(bytes, config.prefault, &mapped);
+                if (raw) kind = BLOCK_MAPPED;
+            }
+#endif
+            if (!raw) {
+                raw = ::operator new(bytes, std::align_val_t(kBlockAlignment), std::nothrow);
+                if (!raw) return nullptr;
+                if (config.prefault) Prefault(raw, bytes);
+            }
+            BlockHeader* header = new (raw) BlockHeader;
+            header->size_class = size_class;
+            header->kind = kind;
+            header->bytes = bytes;
+            header->mapped = mapped;
+            return header;
+        }
+
+        void FreeBlock(BlockHeader* header) {
+#ifdef __linux__
+            if (header->kind == BLOCK_MAPPED) {
+                munmap(header, header->mapped);
+                return;
+            }
+#endif
+            ::operator delete(static_cast<void*>(header), std::align_val_t(kBlockAlignment));
+        }
+
+        inline void* UserPtr(BlockHeader* header) { return header + 1; }
+        inline BlockHeader* HeaderOf(void* p) { return static_cast<BlockHeader*>(p) - 1; }
+
+        std::atomic<uint64_t> next_pool_id{ 0 };
+    }  // namespace
+
+    struct PooledCpuAllocator::State {
+        uint64_t id = next_pool_id.fetch_add(1);
+        Config config;
+        std::mutex mutex;
+        std::condition_variable freed;
+        std::vector<std::vector<BlockHeader*>> central = std::vector<std::vector<BlockHeader*>>(ClassSizes().size());
+        size_t total_bytes = 0;
+        size_t cached_bytes = 0;
+        std::atomic<int> waiters{ 0 };
+        std::atomic<uint64_t> hits{ 0 };
+        std::atomic<uint64_t> misses{ 0 };
+        std::atomic<size_t> huge_bytes{ 0 };
+        // bumped to have the threads release their cached blocks on their next alloc() or free()
+        std::atomic<uint64_t> reclaim_epoch{ 0 };
+
+        ~State() {
+            for (auto& blocks : central) {
+                for (auto block : blocks) FreeBlock(block);
+            }
+        }
+
+        // to the system; called with the mutex held
+        void Release(BlockHeader* block) {
+            total_bytes -= block->bytes;
+            if (block->kind == BLOCK_MAPPED) huge_bytes -= block->mapped;
+            FreeBlock(block);
+        }
+
+        // to the central cache, freed when the cache is full; called with the mutex held
+        void Return(BlockHeader* block) {
+            if (cached_bytes + block->bytes > config.max_cached_bytes) {
+                Release(block);
+                return;
+            }
+            central[block->size_class].push_back(block);
+            cached_bytes += block->bytes;
+        }
+
+        // frees cached blocks until bytes fit in max_bytes; called with the mutex held
+        void ReclaimFor(size_t bytes) {
+            for (size_t c = central.size(); c-- > 0 && total_bytes + bytes > config.max_bytes;) {
+                while (!central[c].empty() && total_bytes + bytes > config.max_bytes) {
+                    BlockHeader* block = central[c].back();
+                    central[c].pop_back();
+                    cached_bytes -= block->bytes;
+                    Release(block);
+                }
+            }
+            if (total_bytes + bytes > config.max_bytes) reclaim_epoch++;
+        }
+    };
+
+    namespace {
+        // free blocks of one thread, by pool
+        class ThreadCache {
+        public:
+            struct Entry {
+                uint64_t pool_id;
+                std::weak_ptr<PooledCpuAllocator::State> state;
+                std::vector<std::vector<BlockHeader*>> blocks;
+                size_t bytes = 0;
+                uint64_t reclaim_epoch = 0;
+            };
+
+            ~ThreadCache() {
+                for (auto& entry : entries_) Flush(&entry);
+            }
+
+            Entry* Get(const std::shared_ptr<PooledCpuAllocator::State>& state) {
+                for (auto iter = entries_.begin(); iter != entries_.end();) {
+                    if (iter->pool_id == state->id) {
+                        uint64_t epoch = state->reclaim_epoch.load();
+                        if (iter->reclaim_epoch != epoch) {
+                            // the pool reclaims memory, give back what this thread keeps
+                            if (iter->bytes > 0) Flush(&*iter, true);
+                            iter->reclaim_epoch = epoch;
+                        }
+                        return &*iter;
+                    }
+                    if (iter->state.expired()) {
+                        // the pool is gone, drop what this thread kept of it
+                        Flush(&*iter);
+                        iter = entries_.erase(iter);
+                    }
+                    else {
+                        ++iter;
+                    }
+                }
+                Entry entry;
+                entry.pool_id = state->id;
+                entry.state = state;
+                entry.reclaim_epoch = state->reclaim_epoch.load();
+                entry.blocks.resize(ClassSizes().size());
+                entries_.push_back(std::move(entry));
+                return &entries_.back();
+            }
+
+            // to the central cache, or to the system with release set
+            static void Flush(Entry* entry, bool release = false) {
+                std::shared_ptr<PooledCpuAllocator::State> state = entry->state.lock();
+                std::unique_lock<std::mutex> lk;
+                if (state) lk = std::unique_lock<std::mutex>(state->mutex);
+                for (auto& blocks : entry->blocks) {
+                    for (auto block : blocks) {
+                        if (state && release) {
+                            state->Release(block);
+                        }
+                        else if (state) {
+                            state->Return(block);
+                        }
+                        else {
+                            FreeBlock(block);
+                        }
+                    }
+                    blocks.clear();
+                }
+                entry->bytes = 0;
+                if (state) state->freed.notify_all();
+            }
+
+        private:
+            std::vector<Entry> entries_;
+        };
+
+        thread_local ThreadCache thread_cache;
+    }  // namespace
+
+    PooledCpuAllocator::PooledCpuAllocator() : PooledCpuAllocator(Config()) {}
+
+    PooledCpuAllocator::PooledCpuAllocator(const Config& config)
+        : MemoryAllocator(-1), state_(std::make_shared<State>()) {
+        state_->config = config;
+    }
+
+    PooledCpuAllocator::~PooledCpuAllocator() = default;
+
+    void* PooledCpuAllocator::alloc(size_t size, int timeout_ms) {
+        uint32_t size_class = ClassOf(size + sizeof(BlockHeader));
+        ThreadCache::Entry* cache = nullptr;
+        if (size_class != kUnpooled && state_->config.thread_cache_bytes > 0) {
+            cache = thread_cache.Get(state_);
+            auto& blocks = cache->blocks[size_class];
+            if (!blocks.empty()) {
+                BlockHeader* block = blocks.back();
+                blocks.pop_back();
+                cache->bytes -= block->bytes;
+                state_->hits++;
+                return UserPtr(block);
+            }
+        }
+
+        std::unique_lock<std::mutex> lk(state_->mutex);
+        if (size_class != kUnpooled && !state_->central[size_class].empty()) {
+            BlockHeader* block = state_->central[size_class].back();
+            state_->central[size_class].pop_back();
+            state_->cached_bytes -= block->bytes;
+            state_->hits++;
+            return UserPtr(block);
+        }
+        size_t bytes = size_class == kUnpooled ? size + sizeof(BlockHeader) : ClassSizes()[size_class];
+        const Config& config = state_->config;
+        if (config.max_bytes > 0 && state_->total_bytes + bytes > config.max_bytes && cache && cache->bytes > 0) {
+            // the blocks this thread keeps count against max_bytes too
+            lk.unlock();
+            ThreadCache::Flush(cache, true);
+            lk.lock();
+        }
+        if (config.max_bytes > 0 && state_->total_bytes + bytes > config.max_bytes) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+            state_->waiters++;
+            while (true) {
+                if (config.max_bytes == 0) break;  // the limit was lifted by SetLimits()
+                state_->ReclaimFor(bytes);
+                if (state_->total_bytes + bytes <= config.max_bytes) break;
+                if (size_class != kUnpooled && !state_->central[size_class].empty()) break;
+                if (timeout_ms == 0) break;
+                if (timeout_ms < 0) {
+                    state_->freed.wait(lk);
+                }
+                else if (state_->freed.wait_until(lk, deadline) == std::cv_status::timeout) {
+                    timeout_ms = 0;  // one more try
+                }
+            }
+            state_->waiters--;
+            if (size_class != kUnpooled && !state_->central[size_class].empty()) {
+                BlockHeader* block = state_->central[size_class].back();
+                state_->central[size_class].pop_back();
+                state_->cached_bytes -= block->bytes;
+                state_->hits++;
+                return UserPtr(block);
+            }
+            if (config.max_bytes > 0 && state_->total_bytes + bytes > config.max_bytes) {
+                return nullptr;
+            }
+        }
+        state_->total_bytes += bytes;
+        lk.unlock();
+
+        BlockHeader* block = AllocBlock(size_class, bytes, config);
+        state_->misses++;
+        if (!block) {
+            lk.lock();
+            state_->total_bytes -= bytes;
+            return nullptr;
+        }
+        if (block->kind == BLOCK_MAPPED) state_->huge_bytes += block->mapped;
+        return UserPtr(block);
+    }
+
+    void PooledCpuAllocator::free(void* p) {
+        if (!p) return;
+        BlockHeader* block = HeaderOf(p);
+        if (block->size_class != kUnpooled && state_->config.thread_cache_bytes > 0) {
+            // also releases the blocks of this thread when the pool reclaims memory
+            ThreadCache::Entry* cache = thread_cache.Get(state_);
+            if (state_->waiters.load() == 0 && cache->bytes + block->bytes <= state_->config.thread_cache_bytes) {
+                cache->blocks[block->size_class].push_back(block);
+                cache->bytes += block->bytes;
+                return;
+            }
+        }
+        std::lock_guard<std::mutex> lk(state_->mutex);
+        if (block->size_class == kUnpooled) {
+            state_->Release(block);
+        }
+        else {
+            state_->Return(block);
+        }
+        state_->freed.notify_all();
+    }
+
+    void PooledCpuAllocator::Reclaim() {
+        std::lock_guard<std::mutex> lk(state_->mutex);
+        for (auto& blocks : state_->central) {
+            for (auto block : blocks) state_->Release(block);
+            blocks.clear();
+        }
+        state_->cached_bytes = 0;
+        state_->reclaim_epoch++;
+    }
+
+    void PooledCpuAllocator::SetLimits(size_t max_bytes, size_t max_cached_bytes) {
+        std::lock_guard<std::mutex> lk(state_->mutex);
+        state_->config.max_bytes = max_bytes;
+        state_->config.max_cached_bytes = max_cached_bytes;
+        for (size_t c = state_->central.size(); c-- > 0 && state_->cached_bytes > max_cached_bytes;) {
+            auto& blocks = state_->central[c];
+            while (!blocks.empty() && state_->cached_bytes > max_cached_bytes) {
+                BlockHeader* block = blocks.back();
+                blocks.pop_back();
+                state_->cached_bytes -= block->bytes;
+                state_->Release(block);
+            }
+        }
+        if (max_bytes > 0) state_->ReclaimFor(0);
+        state_->freed.notify_all();
+    }
+
+    PooledCpuAllocator::Stats PooledCpuAllocator::GetStats() const {
+        std::lock_guard<std::mutex> lk(state_->mutex);
+        Stats stats;
+        stats.total_bytes = state_->total_bytes;
+        stats.cached_bytes = state_->cached_bytes;
+        stats.hits = state_->hits.load();
+        stats.misses = state_->misses.load();
+        stats.huge_bytes = state_->huge_bytes.load();
+        return stats;
+    }
+
+}  // namespace easysa
@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <cstring>
@@ -16,6 +17,7 @@
 #include <vector>
 #include <glog/logging.h>
 
+#include "easysa_allocator.hpp"
 #include "easysa_frame_va.hpp"
 #include "easysa_module.hpp"
 
@@ -28,90 +30,199 @@ namespace easysa {
         if (nullptr != deAllocator_) {
             deAllocator_.reset();
         }
-        if (nullptr != bgr_mat) {
-            delete bgr_mat, bgr_mat = nullptr;
-        }
-
     }
-    /*
     namespace color_cvt {
+        // 3 channel images, libyuv names the BGR memory order RGB24 and the RGB one RAW
         static
-            cv::Mat BGRToBGR(const DataFrame& frame) {
-            // const cv::Mat bgr(frame.height, frame.stride[0], CV_8UC3, const_cast<void*>(frame.data[0]->GetCpuData()));
-            //return bgr(cv::Rect(0, 0, frame.width, frame.height)).clone();
-            return frame.src_mat.clone();
+            cv::Mat PackedImage(const DataFrame& frame) {
+            if (!frame.src_mat.empty()) return frame.src_mat;
+            if (!frame.ptr_cpu[0]) return cv::Mat();
+            // stride is in pixels for packed formats, see DataFrame::GetPlaneBytes
+            return cv::Mat(frame.height, frame.width, CV_8UC3, frame.ptr_cpu[0], frame.stride[0] * 3);
         }
 
         static
-            cv::Mat RGBToBGR(const DataFrame& frame) {
-            const cv::Mat rgb(frame.height, frame.stride[0], CV_8UC3, const_cast<void*>(frame.data[0]->GetCpuData()));
-            cv::Mat bgr;
-            cv::cvtColor(rgb, bgr, cv::COLOR_RGB2BGR);
-            return bgr(cv::Rect(0, 0, frame.width, frame.height)).clone();
+            bool YUVToPacked(const DataFrame& frame, uint8_t* dst, int dst_stride, bool rgb) {
+            const uint8_t* y = reinterpret_cast<const uint8_t*>(frame.ptr_cpu[0]);
+            const uint8_t* u = reinterpret_cast<const uint8_t*>(frame.ptr_cpu[1]);
+            const uint8_t* v = reinterpret_cast<const uint8_t*>(frame.ptr_cpu[2]);
+            if (!y || !u) return false;
+            int ret = -1;
+            switch (frame.fmt) {
+            case PIXEL_FORMAT_YUV420_NV12:
+                ret = rgb ? libyuv::NV12ToRAW(y, frame.stride[0], u, frame.stride[1], dst, dst_stride,
+                    frame.width, frame.height)
+                    : libyuv::NV12ToRGB24(y, frame.stride[0], u, frame.stride[1], dst, dst_stride,
+                        frame.width, frame.height);
+                break;
+            case PIXEL_FORMAT_YUV420_NV21:
+                ret = rgb ? libyuv::NV21ToRAW(y, frame.stride[0], u, frame.stride[1], dst, dst_stride,
+                    frame.width, frame.height)
+                    : libyuv::NV21ToRGB24(y, frame.stride[0], u, frame.stride[1], dst, dst_stride,
+                        frame.width, frame.height);
+                break;
+            case PIXEL_FORMAT_YUV420_I420:
+                if (!v) return false;
+                ret = rgb ? libyuv::I420ToRAW(y, frame.stride[0], u, frame.stride[1], v, frame.stride[2],
+                    dst, dst_stride, frame.width, frame.height)
+                    : libyuv::I420ToRGB24(y, frame.stride[0], u, frame.stride[1], v, frame.stride[2],
+                        dst, dst_stride, frame.width, frame.height);
+                break;
+            default:
+                break;
+            }
+            return ret == 0;
         }
 
-        static
-            cv::Mat YUV420SPToBGR(const DataFrame& frame, bool nv21) {
-            const uint8_t* y_plane = reinterpret_cast<const uint8_t*>(frame.data[0]->GetCpuData());
-            const uint8_t* uv_plane = reinterpret_cast<const uint8_t*>(frame.data[1]->GetCpuData());
-            int width = frame.width;
-            int height = frame.height;
-            int y_stride = frame.stride[0];
-            int uv_stride = frame.stride[1];
-            cv::Mat bgr(height, width, CV_8UC3);
-            uint8_t* dst_bgr24 = bgr.data;
-            int dst_stride = width * 3;
-            // kYvuH709Constants make it to BGR
-            if (nv21)
-                libyuv::NV21ToRGB24Matrix(y_plane, y_stride, uv_plane, uv_stride,
-                    dst_bgr24, dst_stride, &libyuv::kYvuH709Constants, width, height);
-            else
-                libyuv::NV12ToRGB24Matrix(y_plane, y_stride, uv_plane, uv_stride,
-                    dst_bgr24, dst_stride, &libyuv::kYvuH709Constants, width, height);
-            return bgr;
-        }
+    }  // namespace color_cvt
 
-        static inline
-            cv::Mat NV12ToBGR(const DataFrame& frame) {
-            return YUV420SPToBGR(frame, false);
+    bool DataFrame::ConvertColor(CachedView* view, bool rgb) {
+        DataFormat same = rgb ? PIXEL_FORMAT_RGB24 : PIXEL_FORMAT_BGR24;
+        DataFormat swapped = rgb ? PIXEL_FORMAT_BGR24 : PIXEL_FORMAT_RGB24;
+        if (fmt == same) {
+            // no conversion, the view refers to the frame
+            view->mat = color_cvt::PackedImage(*this);
+            return !view->mat.empty();
         }
-
-        static inline
-            cv::Mat NV21ToBGR(const DataFrame& frame) {
-            return YUV420SPToBGR(frame, true);
+        int dst_stride = width * 3;
+        view->buffer = CpuMemAlloc(static_cast<size_t>(dst_stride) * height);
+        if (!view->buffer) return false;
+        uint8_t* dst = reinterpret_cast<uint8_t*>(view->buffer.get());
+        bool ret = false;
+        if (fmt == swapped) {
+            cv::Mat src = color_cvt::PackedImage(*this);
+            if (src.empty()) return false;
+            ret = 0 == libyuv::RGB24ToRAW(src.data, static_cast<int>(src.step[0]), dst, dst_stride, width, height);
+        }
+        else {
+            ret = color_cvt::YUVToPacked(*this, dst, dst_stride, rgb);
         }
+        if (!ret) {
+            view->buffer.reset();
+            return false;
+        }
+        view->mat = cv::Mat(height, width, CV_8UC3, dst, dst_stride);
+        return true;
+    }
 
-        static inline
-            cv::Mat FrameToImageBGR(const DataFrame& frame) {
-            switch (frame.fmt) {
-            case DataFormat::CN_PIXEL_FORMAT_BGR24:
-                return BGRToBGR(frame);
-            case DataFormat::CN_PIXEL_FORMAT_RGB24:
-                return RGBToBGR(frame);
-            case DataFormat::CN_PIXEL_FORMAT_YUV420_NV12:
-                return NV12ToBGR(frame);
-            case DataFormat::CN_PIXEL_FORMAT_YUV420_NV21:
-                return NV21ToBGR(frame);
-            default:
-                LOG(ERROR) << "[frame]" << "Unsupport pixel format. fmt[" << static_cast<int>(frame.fmt) << "]";
+    cv::Mat* DataFrame::GetView(CachedView* view, bool rgb) {
+        std::call_once(view->once, [&]() {
+            if (ConvertColor(view, rgb)) {
+                view->ready.store(true);
             }
-            // never be here
-            abort();
-            return cv::Mat();
-        }
+            else {
+                LOG(ERROR) << "[frame]" << "Convert color failed. fmt[" << static_cast<int>(fmt) << "] to "
+                    << (rgb ? "RGB24" : "BGR24");
+            }
+        });
+        return view->ready.load() ? &view->mat : nullptr;
+    }
 
-    }  // namespace color_cvt
-    */
     cv::Mat* DataFrame::ImageBGR() {
-        std::lock_guard<std::mutex> lk(mtx);
-        if (bgr_mat != nullptr) {
-            return bgr_mat;
+        return GetView(&bgr_view_, false);
+    }
+
+    cv::Mat* DataFrame::ImageRGB() {
+        return GetView(&rgb_view_, true);
+    }
+
+    cv::Mat* DataFrame::ImagePlanarFloat(bool rgb, const std::vector<float>& mean, const std::vector<float>& stddev) {
+        if ((!mean.empty() && mean.size() != 3) || (!stddev.empty() && stddev.size() != 3)) {
+            LOG(ERROR) << "[frame]" << "mean and stddev need one value per channel.";
+            return nullptr;
         }
-        bgr_mat = new (std::nothrow) cv::Mat();
-        if(nullptr == bgr_mat) LOG(ERROR) << "DataFrame::ImageBGR() failed to alloc cv::Mat";
-        // *bgr_mat = color_cvt::FrameToImageBGR(*this);
-        *bgr_mat = src_mat.clone();
-        return bgr_mat;
+        std::shared_ptr<FloatView> view;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            for (auto& cached : float_views_) {
+                if (cached->rgb != rgb) continue;
+                bool same = true;
+                for (int c = 0; c < 3; ++c) {
+                    same &= cached->mean[c] == (mean.empty() ? 0.f : mean[c]);
+                    same &= cached->stddev[c] == (stddev.empty() ? 1.f : stddev[c]);
+                }
+                if (same) {
+                    view = cached;
+                    break;
+                }
+            }
+            if (!view) {
+                view = std::make_shared<FloatView>();
+                view->rgb = rgb;
+                for (int c = 0; c < 3; ++c) {
+                    if (!mean.empty()) view->mean[c] = mean[c];
+                    if (!stddev.empty()) view->stddev[c] = stddev[c];
+                }
+                float_views_.push_back(view);
+            }
+        }
+        std::call_once(view->once, [&]() {
+            cv::Mat* packed = rgb ? ImageRGB() : ImageBGR();
+            if (!packed) return;
+            view->buffer = CpuMemAlloc(sizeof(float) * 3 * width * height);
+            if (!view->buffer) return;
+            float* dst = reinterpret_cast<float*>(view->buffer.get());
+            view->mat = cv::Mat(3 * height, width, CV_32FC1, dst);
+            std::vector<cv::Mat> channels;
+            cv::split(*packed, channels);
+            for (int c = 0; c < 3; ++c) {
+                cv::Mat plane(height, width, CV_32FC1, dst + static_cast<size_t>(c) * width * height);
+                // (x - mean) / std as x * alpha + beta, the conversion is vectorized by opencv
+                double alpha = 1.0 / view->stddev[c];
+                channels[c].convertTo(plane, CV_32F, alpha, -view->mean[c] * alpha);
+            }
+            view->ready.store(true);
+        });
+        return view->ready.load() ? &view->mat : nullptr;
+    }
+
+    cv::Mat* DataFrame::GetScaledImage(int w, int h, DataFormat level_fmt, bool exact) {
+        if (w <= 0 || h <= 0 || (level_fmt != PIXEL_FORMAT_BGR24 && level_fmt != PIXEL_FORMAT_RGB24)) {
+            LOG(ERROR) << "[frame]" << "Unsupported scaled image " << w << "x" << h << " fmt["
+                << static_cast<int>(level_fmt) << "]";
+            return nullptr;
+        }
+        bool rgb = level_fmt == PIXEL_FORMAT_RGB24;
+        if (w == width && h == height) return rgb ? ImageRGB() : ImageBGR();
+        if (!exact && (w > width || h > height)) return rgb ? ImageRGB() : ImageBGR();
+
+        std::shared_ptr<ScaledView> view;
+        cv::Mat from;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            std::shared_ptr<ScaledView> larger;
+            for (auto& level : scaled_views_) {
+                if (level->fmt != level_fmt || level->width < w || level->height < h) continue;
+                bool fits = exact ? (level->width == w && level->height == h) : true;
+                // levels being made count too, their callers wait for them instead of scaling again
+                if (fits && (!view || level->width * level->height < view->width * view->height)) view = level;
+                if (level->ready.load() && (!larger || level->width * level->height < larger->width * larger->height)) {
+                    larger = level;
+                }
+            }
+            if (!view) {
+                view = std::make_shared<ScaledView>();
+                view->width = w;
+                view->height = h;
+                view->fmt = level_fmt;
+                scaled_views_.push_back(view);
+                if (larger) from = larger->mat;
+            }
+        }
+        std::call_once(view->once, [&]() {
+            if (from.empty()) {
+                cv::Mat* full = rgb ? ImageRGB() : ImageBGR();
+                if (!full) return;
+                from = *full;
+            }
+            view->buffer = CpuMemAlloc(static_cast<size_t>(w) * h * 3);
+            if (!view->buffer) return;
+            view->mat = cv::Mat(h, w, CV_8UC3, view->buffer.get());
+            // dst has the requested size and type, cv::resize writes to the pooled buffer
+            cv::resize(from, view->mat, view->mat.size());
+            view->ready.store(true);
+        });
+        return view->ready.load() ? &view->mat : nullptr;
     }
 
     size_t DataFrame::GetPlaneBytes(int plane_idx) const {
@@ -128,6 +239,12 @@ namespace easysa {
                 return std::ceil(1.0 * height * stride[1] / 2);
             else
                 LOG(ERROR) << "[frame]"<< "plane index wrong.";
+            return 0;
+        case PIXEL_FORMAT_YUV420_I420:
+            if (0 == plane_idx)
+                return height * stride[0];
+            else
+                return ((height + 1) / 2) * stride[plane_idx];
         default:
             return 0;
         }
@@ -143,39 +260,61 @@ namespace easysa {
     }
  
 
-    bool InferObject::AddAttribute(const std::string& key, const InferAttr& value) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        if (attributes_.find(key) != attributes_.end()) return false;
+    // objects of their own get a small feature arena, 1 KB for the first block
+    InferObject::InferObject()
+        : table_(std::make_shared<InferObjTable>(256)), row_(table_->AddObject(InferBoundingBox{ 0, 0, 0, 0 }, 0)) {}
 
-        attributes_.insert(std::make_pair(key, value));
-        return true;
+    InferObject::InferObject(std::shared_ptr<InferObjTable> table, size_t row) : table_(table), row_(row) {}
+
+    InferBoundingBox InferObject::GetBBox() const {
+        return table_->GetBBox(row_);
     }
 
-    bool InferObject::AddAttribute(const std::pair<std::string, InferAttr>& attribute) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        if (attributes_.find(attribute.first) != attributes_.end()) return false;
+    void InferObject::SetBBox(const InferBoundingBox& bbox) {
+        table_->SetBBox(row_, bbox);
+    }
 
-        attributes_.insert(attribute);
-        return true;
+    float InferObject::GetScore() const {
+        return table_->GetScore(row_);
     }
 
-    InferAttr InferObject::GetAttribute(const std::string& key) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        if (attributes_.find(key) != attributes_.end()) return attributes_[key];
+    void InferObject::SetScore(float score) {
+        table_->SetScore(row_, score);
+    }
 
-        return InferAttr();
+    int InferObject::GetClassId() const {
+        return table_->GetClassId(row_);
     }
 
-    bool InferObject::AddExtraAttribute(const std::string& key, const std::string& value) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        if (extra_attributes_.find(key) != extra_attributes_.end()) return false;
+    void InferObject::SetClassId(int class_id) {
+        table_->SetClassId(row_, class_id);
+    }
 
-        extra_attributes_.insert(std::make_pair(key, value));
-        return true;
+    int64_t InferObject::GetTrackId() const {
+        return table_->GetTrackId(row_);
+    }
+
+    void InferObject::SetTrackId(int64_t track_id) {
+        table_->SetTrackId(row_, track_id);
+    }
+
+    bool InferObject::AddAttribute(const std::string& key, const InferAttr& value) {
+        return table_->AddAttribute(row_, key, value);
+    }
+
+    bool InferObject::AddAttribute(const std::pair<std::string, InferAttr>& attribute) {
+        return AddAttribute(attribute.first, attribute.second);
+    }
+
+    InferAttr InferObject::GetAttribute(const std::string& key) {
+        return table_->GetAttribute(row_, key);
+    }
+
+    bool InferObject::AddExtraAttribute(const std::string& key, const std::string& value) {
+        return table_->AddExtraAttribute(row_, key, value);
     }
 
     bool InferObject::AddExtraAttributes(const std::vector<std::pair<std::string, std::string>>& attributes) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
         bool ret = true;
         for (auto& attribute : attributes) {
             ret &= AddExtraAttribute(attribute.first, attribute.second);
@@ -184,46 +323,72 @@ namespace easysa {
     }
 
     std::string InferObject::GetExtraAttribute(const std::string& key) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        if (extra_attributes_.find(key) != extra_attributes_.end()) {
-            return extra_attributes_[key];
-        }
-        return "";
+        return table_->GetExtraAttribute(row_, key);
     }
 
     bool InferObject::RemoveExtraAttribute(const std::string& key) {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        if (extra_attributes_.find(key) != extra_attributes_.end()) {
-            extra_attributes_.erase(key);
-        }
+        table_->RemoveExtraAttribute(row_, InferKeys::Find(key));
         return true;
     }
 
     StringPairs InferObject::GetExtraAttributes() {
-        std::lock_guard<std::mutex> lk(attribute_mutex_);
-        return StringPairs(extra_attributes_.begin(), extra_attributes_.end());
+        std::vector<std::pair<int, std::string>> entries = table_->GetExtraAttributes(row_);
+        StringPairs pairs;
+        pairs.reserve(entries.size());
+        for (auto& entry : entries) {
+            pairs.emplace_back(InferKeys::Name(entry.first), std::move(entry.second));
+        }
+        return pairs;
     }
 
     bool InferObject::AddFeature(const std::string& key, const InferFeature& feature) {
-        std::lock_guard<std::mutex> lk(feature_mutex_);
-        if (features_.find(key) != features_.end()) {
-            return false;
+        return AddFeature(key, feature.data(), feature.size());
+    }
+
+    bool InferObject::AddFeature(const std::string& key, const float* data, size_t size) {
+        return table_->AddFeature(row_, InferKeys::Intern(key), data, size);
+    }
+
+    FeatureSpan InferObject::GetFeatureSpan(const std::string& key) {
+        return GetFeatureSpan(InferKeys::Find(key));
+    }
+
+    FeatureSpan InferObject::GetFeatureSpan(int key) {
+        return table_->GetFeatureSpan(row_, key);
+    }
+
+    InferFeatureSpans InferObject::GetFeatureSpans() {
+        std::vector<std::pair<int, FeatureSpan>> entries = table_->GetFeatureSpans(row_);
+        InferFeatureSpans spans;
+        spans.reserve(entries.size());
+        for (auto& entry : entries) {
+            spans.emplace_back(InferKeys::Name(entry.first), entry.second);
         }
-        features_.insert(std::make_pair(key, feature));
-        return true;
+        return spans;
     }
 
     InferFeature InferObject::GetFeature(const std::string& key) {
-        std::lock_guard<std::mutex> lk(feature_mutex_);
-        if (features_.find(key) != features_.end()) {
-            return features_[key];
-        }
-        return InferFeature();
+        return GetFeatureSpan(key).ToVector();
     }
 
     InferFeatures InferObject::GetFeatures() {
-        std::lock_guard<std::mutex> lk(feature_mutex_);
-        return InferFeatures(features_.begin(), features_.end());
+        InferFeatureSpans spans = GetFeatureSpans();
+        InferFeatures features;
+        features.reserve(spans.size());
+        for (auto& span : spans) {
+            features.emplace_back(span.first, span.second.ToVector());
+        }
+        return features;
+    }
+
+    std::shared_ptr<InferObject> InferObjs::AddObject(const InferBoundingBox& bbox, float score, int class_id,
+        int64_t track_id) {
+        // under mutex_, so objs_ lists the objects in the order of their rows
+        std::lock_guard<std::mutex> lk(mutex_);
+        size_t row = table_->AddObject(bbox, score, class_id, track_id);
+        std::shared_ptr<InferObject> obj = std::make_shared<InferObject>(table_, row);
+        objs_.push_back(obj);
+        return obj;
     }
 
 }  // namespace easysa
\ No newline at end of file
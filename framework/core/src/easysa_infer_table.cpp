@@ -0,0 +1,295 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "easysa_infer_table.hpp"
+
+namespace easysa {
+
+    namespace {
+        // names of all keys, a deque keeps the references returned by Name() valid
+        struct KeyRegistry {
+            std::shared_mutex mutex;
+            std::unordered_map<std::string, int> keys;
+            std::deque<std::string> names;
+        };
+
+        KeyRegistry& GetKeyRegistry() {
+            static KeyRegistry registry;
+            return registry;
+        }
+    }  // namespace
+
+    int InferKeys::Intern(const std::string& name) {
+        KeyRegistry& registry = GetKeyRegistry();
+        {
+            std::shared_lock<std::shared_mutex> lk(registry.mutex);
+            auto iter = registry.keys.find(name);
+            if (iter != registry.keys.end()) return iter->second;
+        }
+        std::unique_lock<std::shared_mutex> lk(registry.mutex);
+        auto iter = registry.keys.find(name);
+        if (iter != registry.keys.end()) return iter->second;
+        int key = static_cast<int>(registry.names.size());
+        registry.names.push_back(name);
+        registry.keys.emplace(name, key);
+        return key;
+    }
+
+    int InferKeys::Find(const std::string& name) {
+        KeyRegistry& registry = GetKeyRegistry();
+        std::shared_lock<std::shared_mutex> lk(registry.mutex);
+        auto iter = registry.keys.find(name);
+        return iter == registry.keys.end() ? -1 : iter->second;
+    }
+
+    const std::string& InferKeys::Name(int key) {
+        static const std::string empty;
+        KeyRegistry& registry = GetKeyRegistry();
+        std::shared_lock<std::shared_mutex> lk(registry.mutex);
+        if (key < 0 || static_cast<size_t>(key) >= registry.names.size()) return empty;
+        return registry.names[key];
+    }
+
+    float* FeatureArena::Allocate(size_t size) {
+        constexpr size_t kAlignFloats = kAlignment / sizeof(float);
+        // every feature starts on its own cache line
+        size_t rounded = (std::max<size_t>(size, 1) + kAlignFloats - 1) / kAlignFloats * kAlignFloats;
+        if (blocks_.empty() || blocks_.back().capacity - blocks_.back().used < rounded) {
+            Block block;
+            block.capacity = std::max(rounded, next_block_floats_);
+            next_block_floats_ = std::min(next_block_floats_ * 2, kBlockFloats);
+            block.raw.reset(new (std::nothrow) char[block.capacity * sizeof(float) + kAlignment]);
+            if (!block.raw) return nullptr;
+            uintptr_t addr = reinterpret_cast<uintptr_t>(block.raw.get());
+            block.data = reinterpret_cast<float*>((addr + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1));
+            bytes_ += block.capacity * sizeof(float) + kAlignment;
+            blocks_.push_back(std::move(block));
+        }
+        Block& block = blocks_.back();
+        float* ptr = block.data + block.used;
+        block.used += rounded;
+        return ptr;
+    }
+
+    void FeatureArena::Clear() {
+        // the first block is kept for the next frame's features
+        if (blocks_.size() > 1) {
+            blocks_.erase(blocks_.begin() + 1, blocks_.end());
+            bytes_ = blocks_[0].capacity * sizeof(float) + kAlignment;
+        }
+        if (!blocks_.empty()) blocks_[0].used = 0;
+    }
+
+    template <typename Entry>
+    uint32_t InferObjTable::FindEntry(const std::vector<Entry>& entries, uint32_t head, int key) {
+        for (uint32_t i = head; i != kNoEntry; i = entries[i].next) {
+            if (entries[i].key == key) return i;
+        }
+        return kNoEntry;
+    }
+
+    template <typename Entry>
+    void InferObjTable::PushEntry(std::vector<Entry>* entries, uint32_t* head, Entry entry) {
+        entry.next = *head;
+        *head = static_cast<uint32_t>(entries->size());
+        entries->push_back(std::move(entry));
+    }
+
+    void InferObjTable::Reserve(size_t objects) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        bboxes_.reserve(objects);
+        scores_.reserve(objects);
+        class_ids_.reserve(objects);
+        track_ids_.reserve(objects);
+        heads_.reserve(objects);
+    }
+
+    size_t InferObjTable::AddObject(const InferBoundingBox& bbox, float score, int class_id, int64_t track_id) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        bboxes_.push_back(bbox);
+        scores_.push_back(score);
+        class_ids_.push_back(class_id);
+        track_ids_.push_back(track_id);
+        heads_.emplace_back();
+        return bboxes_.size() - 1;
+    }
+
+    size_t InferObjTable::Size() const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return bboxes_.size();
+    }
+
+    void InferObjTable::Clear() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        bboxes_.clear();
+        scores_.clear();
+        class_ids_.clear();
+        track_ids_.clear();
+        heads_.clear();
+        attributes_.clear();
+        extra_attributes_.clear();
+        features_.clear();
+        arena_.Clear();
+    }
+
+    InferBoundingBox InferObjTable::GetBBox(size_t row) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return row < bboxes_.size() ? bboxes_[row] : InferBoundingBox{ 0, 0, 0, 0 };
+    }
+
+    float InferObjTable::GetScore(size_t row) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return row < scores_.size() ? scores_[row] : 0;
+    }
+
+    int InferObjTable::GetClassId(size_t row) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return row < class_ids_.size() ? class_ids_[row] : -1;
+    }
+
+    int64_t InferObjTable::GetTrackId(size_t row) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return row < track_ids_.size() ? track_ids_[row] : -1;
+    }
+
+    bool InferObjTable::SetBBox(size_t row, const InferBoundingBox& bbox) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= bboxes_.size()) return false;
+        bboxes_[row] = bbox;
+        return true;
+    }
+
+    bool InferObjTable::SetScore(size_t row, float score) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= scores_.size()) return false;
+        scores_[row] = score;
+        return true;
+    }
+
+    bool InferObjTable::SetClassId(size_t row, int class_id) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= class_ids_.size()) return false;
+        class_ids_[row] = class_id;
+        return true;
+    }
+
+    bool InferObjTable::SetTrackId(size_t row, int64_t track_id) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= track_ids_.size()) return false;
+        track_ids_[row] = track_id;
+        return true;
+    }
+
+    bool InferObjTable::AddAttribute(size_t row, int key, const InferAttr& value) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size() || key < 0) return false;
+        uint32_t* head = &heads_[row].attributes;
+        if (FindEntry(attributes_, *head, key) != kNoEntry) return false;
+        PushEntry(&attributes_, head, AttrEntry{ key, kNoEntry, value });
+        return true;
+    }
+
+    InferAttr InferObjTable::GetAttribute(size_t row, int key) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size()) return InferAttr();
+        uint32_t i = FindEntry(attributes_, heads_[row].attributes, key);
+        return i != kNoEntry ? attributes_[i].value : InferAttr();
+    }
+
+    bool InferObjTable::AddExtraAttribute(size_t row, int key, const std::string& value) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size() || key < 0) return false;
+        uint32_t* head = &heads_[row].extra_attributes;
+        if (FindEntry(extra_attributes_, *head, key) != kNoEntry) return false;
+        PushEntry(&extra_attributes_, head, ExtraEntry{ key, kNoEntry, value });
+        return true;
+    }
+
+    std::string InferObjTable::GetExtraAttribute(size_t row, int key) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size()) return std::string();
+        uint32_t i = FindEntry(extra_attributes_, heads_[row].extra_attributes, key);
+        return i != kNoEntry ? extra_attributes_[i].value : std::string();
+    }
+
+    bool InferObjTable::RemoveExtraAttribute(size_t row, int key) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size()) return false;
+        // unlinked only, the entry is dropped with the next Clear()
+        uint32_t* link = &heads_[row].extra_attributes;
+        while (*link != kNoEntry) {
+            ExtraEntry& entry = extra_attributes_[*link];
+            if (entry.key == key) {
+                *link = entry.next;
+                entry.value.clear();
+                return true;
+            }
+            link = &entry.next;
+        }
+        return false;
+    }
+
+    std::vector<std::pair<int, std::string>> InferObjTable::GetExtraAttributes(size_t row) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        std::vector<std::pair<int, std::string>> pairs;
+        if (row >= heads_.size()) return pairs;
+        for (uint32_t i = heads_[row].extra_attributes; i != kNoEntry; i = extra_attributes_[i].next) {
+            pairs.emplace_back(extra_attributes_[i].key, extra_attributes_[i].value);
+        }
+        std::reverse(pairs.begin(), pairs.end());
+        return pairs;
+    }
+
+    bool InferObjTable::AddFeature(size_t row, int key, const float* data, size_t size) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size() || key < 0) return false;
+        uint32_t* head = &heads_[row].features;
+        if (FindEntry(features_, *head, key) != kNoEntry) return false;
+        float* dst = arena_.Allocate(size);
+        if (!dst) return false;
+        if (size) memcpy(dst, data, size * sizeof(float));
+        PushEntry(&features_, head, FeatureEntry{ key, kNoEntry, FeatureSpan{ dst, size } });
+        return true;
+    }
+
+    FeatureSpan InferObjTable::GetFeatureSpan(size_t row, int key) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (row >= heads_.size()) return FeatureSpan();
+        uint32_t i = FindEntry(features_, heads_[row].features, key);
+        return i != kNoEntry ? features_[i].span : FeatureSpan();
+    }
+
+    std::vector<std::pair<int, FeatureSpan>> InferObjTable::GetFeatureSpans(size_t row) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        std::vector<std::pair<int, FeatureSpan>> spans;
+        if (row >= heads_.size()) return spans;
+        for (uint32_t i = heads_[row].features; i != kNoEntry; i = features_[i].next) {
+            spans.emplace_back(features_[i].key, features_[i].span);
+        }
+        std::reverse(spans.begin(), spans.end());
+        return spans;
+    }
+
+    InferFeature InferObjTable::GetFeature(size_t row, int key) const {
+        return GetFeatureSpan(row, key).ToVector();
+    }
+
+}  // namespace easysa
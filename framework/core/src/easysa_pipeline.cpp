@@ -112,6 +112,7 @@ namespace easysa {
             case StreamMsgType::ERROR_MSG:
             case StreamMsgType::STREAM_ERR_MSG:
             case StreamMsgType::FRAME_ERR_MSG:
+            case StreamMsgType::STREAM_CATCHUP_MSG:
             case StreamMsgType::USER_MSG0:
             case StreamMsgType::USER_MSG1:
             case StreamMsgType::USER_MSG2:
@@ -160,6 +161,13 @@ namespace easysa {
         delete idxManager_;
     }
 
+    int64_t Pipeline::GetStreamOutputTimestamp(const std::string& stream_id) {
+        std::lock_guard<std::mutex> lk(output_ts_mtx_);
+        auto iter = output_ts_.find(stream_id);
+        if (iter == output_ts_.end()) return -1;
+        return iter->second;
+    }
+
     void Pipeline::SetStreamMsgObserver(StreamMsgObserver* observer) {
         smsg_observer_ = observer;
     }
@@ -205,6 +213,18 @@ namespace easysa {
             ret = EVENT_HANDLE_SYNCED;
             break;
         }
+        case EventType::EVENT_STREAM_CATCHUP: {
+            smsg.type = STREAM_CATCHUP_MSG;
+            smsg.module_name = event.module_name;
+            smsg.stream_id = event.stream_id;
+            smsg.pts = event.pts;
+            smsg.skipped_packets = event.count;
+            UpdateByStreamMsg(smsg);
+            LOG(WARNING) << "[core]:" << "[" << event.module_name << "]: "
+                << "stream " << event.stream_id << " catch up: " << event.message;
+            ret = EVENT_HANDLE_SYNCED;
+            break;
+        }
         case EventType::EVENT_INVALID:
             LOG(ERROR) << "[core]:" << "[" << event.module_name << "]: "
                 << "Info: " << event.message;
@@ -443,8 +463,10 @@ namespace easysa {
                 msg.module_name = moduleName;
                 UpdateByStreamMsg(msg);
             }
-            if (profiler_ && IsLeafNode(moduleName) && PassedByAllModules(changed_mask)) {
-                profiler_->OnStreamEos(data->stream_id);
+            if (IsLeafNode(moduleName) && PassedByAllModules(changed_mask)) {
+                if (profiler_) profiler_->OnStreamEos(data->stream_id);
+                std::lock_guard<std::mutex> lk(output_ts_mtx_);
+                output_ts_.erase(data->stream_id);
             }
         }
         else {
@@ -452,8 +474,13 @@ namespace easysa {
             if (IsStreamRemoved(data->stream_id)) {
                 return;
             }
+            bool output = IsLeafNode(moduleName) && PassedByAllModules(changed_mask);
+            if (output) {
+                std::lock_guard<std::mutex> lk(output_ts_mtx_);
+                output_ts_[data->stream_id] = data->timestamp;
+            }
             if (profiler_) {
-                if (IsLeafNode(moduleName) && PassedByAllModules(changed_mask)) {
+                if (output) {
                     profiler_->RecordOutput(profiling_record_key);
                 }
                 if (!IsRootNode(moduleName)) {
@@ -5,9 +5,12 @@
  *
  *     http://www.apache.org/licenses/LICENSE-2.0
  *************************************************************************/
+#include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -83,28 +86,82 @@ namespace easysa {
             return false;
         }
         std::string stream_id = handler->GetStreamId();
-        std::unique_lock<std::mutex> lock(mtx_);
-        if (source_map_.find(stream_id) != source_map_.end()) {
-            LOG(ERROR) << "[core]:" << "Duplicate stream_id\n";
-            return false;
-        }
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (source_map_.find(stream_id) != source_map_.end() || pending_.find(stream_id) != pending_.end()) {
+                LOG(ERROR) << "[core]:" << "Duplicate stream_id\n";
+                return false;
+            }
 
-        if (source_map_.size() >= GetMaxStreamNumber()) {
-            LOG(ERROR) << "[core]:" << handler->GetStreamId()
-                << " doesn't add to pipeline because of maximum limitation: " << GetMaxStreamNumber();
-            return false;
-        }
+            if (source_map_.size() + pending_.size() >= GetMaxStreamNumber()) {
+                LOG(ERROR) << "[core]:" << handler->GetStreamId()
+                    << " doesn't add to pipeline because of maximum limitation: " << GetMaxStreamNumber();
+                return false;
+            }
 
-        handler->SetStreamUniqueIdx(source_idx_);
-        source_idx_++;
+            handler->SetStreamUniqueIdx(source_idx_);
+            source_idx_++;
+            pending_.insert(stream_id);
+        }
 
+        // opened without the lock, so streams are brought up concurrently
         SetStreamRemoved(stream_id, false);
-        if (handler->Open() != true) {
+        bool opened = handler->Open();
+        std::unique_lock<std::mutex> lock(mtx_);
+        pending_.erase(stream_id);
+        auto removed = removed_pending_.find(stream_id);
+        if (removed != removed_pending_.end()) {
+            // removed while opening, the handler is never committed
+            bool force = removed->second;
+            removed_pending_.erase(removed);
+            lock.unlock();
+            LOG(WARNING) << "[core]:" << stream_id << " removed while opening";
+            if (opened) {
+                SetStreamRemoved(stream_id, force);
+                handler->Close();
+                CheckStreamEosReached(stream_id, force);
+            }
+            SetStreamRemoved(stream_id, false);
+            return false;
+        }
+        if (opened != true) {
             LOG(ERROR) << "[core]:" << "source Open failed";
             return false;
         }
         source_map_[stream_id] = handler;
-        return 0;
+        return true;
+    }
+
+    std::vector<bool> SourceModule::AddSources(const std::vector<std::shared_ptr<SourceHandler>>& handlers,
+        uint32_t max_concurrency) {
+        std::vector<bool> results(handlers.size(), false);
+        if (handlers.empty()) return results;
+        if (max_concurrency == 0) {
+            max_concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        size_t thread_num = std::min<size_t>(max_concurrency, handlers.size());
+        std::atomic<size_t> next{ 0 };
+        std::vector<char> added(handlers.size(), 0);  // std::vector<bool> can not be written concurrently
+        auto worker = [&]() {
+            for (size_t i = next++; i < handlers.size(); i = next++) {
+                added[i] = AddSource(handlers[i]) ? 1 : 0;
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_num; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        size_t added_num = 0;
+        for (size_t i = 0; i < handlers.size(); ++i) {
+            results[i] = added[i] != 0;
+            added_num += added[i];
+        }
+        LOG(INFO) << "[core]:" << "added " << added_num << " of " << handlers.size() << " sources";
+        return results;
     }
 
     int SourceModule::RemoveSource(std::shared_ptr<SourceHandler> handler, bool force) {
@@ -129,6 +186,11 @@ namespace easysa {
             std::unique_lock<std::mutex> lock(mtx_);
             auto iter = source_map_.find(stream_id);
             if (iter == source_map_.end()) {
+                if (pending_.find(stream_id) != pending_.end()) {
+                    // still opening, AddSource closes it once Open returns
+                    removed_pending_[stream_id] = force;
+                    return 0;
+                }
                 LOG(WARNING) << "[core]:" << "source does not exist\n";
                 return 0;
             }
@@ -155,6 +217,9 @@ namespace easysa {
             for (auto& iter : source_map_) {
                 SetStreamRemoved(iter.first, force);
             }
+            for (auto& stream_id : pending_) {
+                removed_pending_[stream_id] = force;
+            }
         }
         {
             std::unique_lock<std::mutex> lock(mtx_);
@@ -12,7 +12,10 @@
 #include <utility>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <sstream>
+#include "easysa_allocator.hpp"
 #include "easysa_config.hpp"
 #include "easysa_source.hpp"
 #include "easysa_module.hpp"
@@ -28,6 +31,20 @@ namespace easysa {
 	  DECODER_CPU = 0, //use cpu decoder
 	  DECODER_CUDA
 	};
+	enum OutputFormat {
+	  OUTPUT_FORMAT_NV12 = 0, // convert decoded frames to NV12
+	  OUTPUT_FORMAT_I420, // deliver I420 frames as decoded, planes reference the decoder buffer (cpu output only)
+	};
+	enum LoopMode {
+	  LOOP_REOPEN = 0, // close and reopen the demuxer at the end of file
+	  LOOP_CACHE, // demux the file once into a cache shared by all streams of the file, replay it with rebased pts
+	  LOOP_SEEK, // seek back to the start, keep the demuxer and the decoder open, for files too large to cache
+	};
+	enum DecoderThreadType {
+	  DECODER_THREAD_FRAME = 0, // frame threading, more throughput but adds (threads - 1) frames of latency
+	  DECODER_THREAD_SLICE, // slice threading, no extra latency, depends on the stream being multi-sliced
+	  DECODER_THREAD_AUTO // let the codec pick frame and/or slice threading
+	};
 	struct DataSourceParam {
 		OutputType output_type_ = OUTPUT_CPU;
 		size_t interval_ = 1;
@@ -35,6 +52,73 @@ namespace easysa {
 		uint32_t input_buf_number_ = 2;
 		uint32_t output_buf_number_ = 3;
 		int device_id_ = -1;
+		/*
+		* decoder threads of one stream, 0 means sizing it from the stream resolution.
+		* The total over all streams is capped by max_decoder_threads_ (0 means no cap).
+		*/
+		uint32_t decoder_threads_ = 1;
+		DecoderThreadType thread_type_ = DECODER_THREAD_FRAME;
+		uint32_t max_decoder_threads_ = 0;
+		OutputFormat output_format_ = OUTPUT_FORMAT_NV12;
+		/*
+		* with interval_ > 1, packets whose frames will be discarded are decoded with
+		* AVDISCARD_NONREF, so non-reference frames among them are not decoded at all.
+		*/
+		bool skip_nonref_ = true;
+		bool keyframe_only_ = false;  // decode key frames only, interval_ then applies to key frames
+		/*
+		* number of worker threads shared by all file and image folder streams of the module,
+		* 0 means the number of cores. Streams are paced by deadlines of the workers' timer
+		* rather than by a sleeping thread each.
+		*/
+		uint32_t decode_workers_ = 0;
+		bool use_mmap_ = false;  // read local files through a memory mapping shared by all streams of the file
+		LoopMode loop_mode_ = LOOP_REOPEN;  // used by streams created with loop = true
+		size_t loop_cache_max_bytes_ = 256 * 1024 * 1024;  // files with more packet data use LOOP_REOPEN
+		/*
+		* scale frames down to the analysis resolution in the decode thread, 0 keeps the source size.
+		* Frames are never scaled up. With keep_aspect_ the frame fits in output_width_ x output_height_.
+		*/
+		uint32_t output_width_ = 0;
+		uint32_t output_height_ = 0;
+		bool keep_aspect_ = true;
+		bool keep_full_res_ = false;  // also keep the full resolution planes, see DataFrame::full_cpu_data
+		/*
+		* packets read ahead by a demux thread of each file stream, so file I/O overlaps decoding.
+		* 0 demuxes and decodes on the same thread.
+		*/
+		uint32_t demux_queue_size_ = 0;
+		int64_t probesize_ = 0;  // bytes read to probe a stream, 0 uses the FFmpeg default
+		int64_t analyzeduration_ = 0;  // microseconds analyzed to probe a stream, 0 uses the FFmpeg default
+		std::string probe_cache_path_;  // file keeping probe results, known sources skip probing, empty disables it
+		/*
+		* file streams of the same url share one decoder, every stream still applies interval_ itself.
+		* The shared frames are read-only.
+		*/
+		bool shared_decode_ = false;
+		/*
+		* image folder streams: decode threads per stream (0 means hardware threads),
+		* images decoded ahead of delivery (0 means twice the threads)
+		*/
+		uint32_t image_workers_ = 0;
+		uint32_t image_read_ahead_ = 0;
+		/*
+		* when the pipeline output of a file stream lags its demuxing by more than this, the source drops
+		* packets up to the next key frame and flushes the decoder. 0 disables it. Streams without pts
+		* are never skipped, their lag is unknown.
+		*/
+		uint32_t max_lag_ms_ = 0;
+		/*
+		* back decoded frame buffers with huge pages (reserved, else transparent, else normal pages),
+		* and fault their pages in when they are allocated. Linux only for huge pages.
+		*/
+		bool huge_pages_ = false;
+		bool prefault_frames_ = false;
+		/*
+		* allocator of decoded frame buffers shared by all streams, created by Open() when
+		* huge_pages_ or prefault_frames_ is set; nullptr uses page aligned buffers.
+		*/
+		std::shared_ptr<MemoryAllocator> frame_allocator_;
 	};
 
 	struct ESPacket {
@@ -51,6 +135,8 @@ namespace easysa {
 		};
 	}; // struct ESPacket
 
+	class DecodeScheduler;
+	class SharedDecodeStream;
 	class DataSource : public SourceModule, public ModuleCreator<DataSource> {
 	 public:
 		 explicit DataSource(const std::string& module_name);
@@ -58,8 +144,19 @@ namespace easysa {
 		 bool Open(ModuleParamSet param_set) override;
 		 bool Close() override;
 		 DataSourceParam GetParam() const { return param_; }
+		 /*
+		 * @return the scheduler shared by the file and image folder streams, nullptr before Open()
+		 */
+		 DecodeScheduler* GetDecodeScheduler() const { return scheduler_.get(); }
+		 /*
+		 * @return the decoding of the url shared by streams, created if no stream holds it yet
+		 */
+		 std::shared_ptr<SharedDecodeStream> GetSharedDecodeStream(const std::string& url, int framerate, bool loop);
 	private:
 		DataSourceParam param_;
+		std::shared_ptr<DecodeScheduler> scheduler_ = nullptr;
+		std::mutex shared_streams_mutex_;
+		std::unordered_map<std::string /*url*/, std::weak_ptr<SharedDecodeStream>> shared_streams_;
 	}; // class DataSource
 
 	/*
@@ -78,6 +175,61 @@ namespace easysa {
 		FileHandlerImpl* impl_ = nullptr;
 	}; // class FileHander
 
+	/*
+	* @brief source handler for H.264/H.265 elementary streams fed from memory
+	*/
+	class ESMemHandlerImpl;
+	class ESMemHandler : public SourceHandler {
+	public:
+		enum DataType {
+			INVALID,
+			H264,
+			H265
+		};
+		static std::shared_ptr<SourceHandler> Create(DataSource* module, const std::string& stream_id);
+		~ESMemHandler();
+		bool Open() override;
+		void Close() override;
+		/*
+		* sets the codec of the stream, must be called before Open()
+		*/
+		int SetDataType(DataType type);
+		/*
+		* feeds one Annex-B packet, the data is copied. Blocks while the packet queue is full.
+		* A packet with FLAG_EOS or nullptr ends the stream.
+		* @return 0 on success, -1 if the handler is not open or already got EOS
+		*/
+		int Write(ESPacket* pkt);
+		/*
+		* feeds one packet without copying it, owner keeps the data alive until the decoder releases it.
+		* data must be followed by 64 readable padding bytes, as required by the decoder.
+		*/
+		int Write(ESPacket* pkt, std::shared_ptr<void> owner);
+	private:
+		explicit ESMemHandler(DataSource* module, const std::string& stream_id);
+	private:
+		ESMemHandlerImpl* impl_ = nullptr;
+	}; // class ESMemHandler
+
+	/*
+	* @brief source handler for still images, delivered in order as BGR24 frames followed by EOS
+	*
+	* path is a directory or a glob pattern (jpg, jpeg, png, bmp and tif files, sorted by name), or a manifest
+	* file listing one image per line, relative paths being relative to the manifest.
+	*/
+	class ImageFolderHandlerImpl;
+	class ImageFolderHandler : public SourceHandler {
+	public:
+		static std::shared_ptr<SourceHandler> Create(DataSource* module, const std::string& stream_id, const std::string& path, int frame_rate = 0);
+		~ImageFolderHandler();
+		bool Open() override;
+		void Close() override;
+	private:
+		explicit ImageFolderHandler(DataSource* module, const std::string& stream_id, const std::string& path, int frame_rate);
+	private:
+		ImageFolderHandlerImpl* impl_ = nullptr;
+	}; // class ImageFolderHandler
+
 } // namespace easysa
 
 #endif // MODULES_SOURCE_DATA_SOURCE_HPP_
\ No newline at end of file
@@ -16,11 +16,16 @@
 
 #include "data_handler_file.hpp"
 #include "easysa_eventbus.hpp"
+#include "easysa_pipeline.hpp"
 #include "profiler/module_profiler.hpp"
 #include "profiler/pipeline_profiler.hpp"
 
 namespace easysa {
 
+    static constexpr size_t kMaxWantedPts = 64;
+    static constexpr int kQueueWaitMs = 10;
+    static constexpr int kStarvedRetryMs = 2;  // a scheduled stream waiting for its demux thread
+
     std::shared_ptr<SourceHandler> FileHandler::Create(DataSource* module, const std::string& stream_id,
         const std::string& filename, int framerate, bool loop) {
         if (!module || stream_id.empty() || filename.empty()) {
@@ -72,59 +77,109 @@ namespace easysa {
     bool FileHandlerImpl::Open() {
         DataSource* source = dynamic_cast<DataSource*>(module_);
         param_ = source->GetParam();
-        // start separate thread
         running_.store(1);
-        thread_ = std::thread(&FileHandlerImpl::Loop, this);
+        if (param_.shared_decode_) {
+            shared_ = source->GetSharedDecodeStream(filename_, framerate_, loop_);
+            if (!shared_ || !shared_->Subscribe(this)) {
+                shared_.reset();
+                running_.store(0);
+                return false;
+            }
+            return true;
+        }
+        // run on the workers shared by all streams
+        scheduler_ = source->GetDecodeScheduler();
+        if (!scheduler_ || !scheduler_->Add(this)) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Schedule stream failed";
+            running_.store(0);
+            return false;
+        }
         return true;
     }
 
     void FileHandlerImpl::Close() {
         if (running_.load()) {
             running_.store(0);
-            if (thread_.joinable()) {
-                thread_.join();
+            if (shared_) {
+                shared_->Unsubscribe(this);
+                shared_.reset();
+            }
+            if (scheduler_) {
+                scheduler_->Remove(this);
+                ClearResources();  // nothing left to clear if the stream finished by itself
             }
         }
     }
 
-    void FileHandlerImpl::Loop() {
-        if (!PrepareResources()) {
-            ClearResources();
-            if (nullptr != module_) {
-                Event e;
-                e.type = EventType::EVENT_STREAM_ERROR;
-                e.module_name = module_->GetName();
-                e.message = "Prepare codec resources failed.";
-                e.stream_id = stream_id_;
-                e.thread_id = std::this_thread::get_id();
-                module_->PostEvent(e);
-            }
-            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
-                << "PrepareResources failed.";
-            return;
+    void FileHandlerImpl::PostStreamError(const std::string& message) {
+        if (nullptr != module_) {
+            Event e;
+            e.type = EventType::EVENT_STREAM_ERROR;
+            e.module_name = module_->GetName();
+            e.message = message;
+            e.stream_id = stream_id_;
+            e.thread_id = std::this_thread::get_id();
+            module_->PostEvent(e);
         }
+    }
 
-        FrController controller(framerate_);
-        if (framerate_ > 0) controller.Start();
-
-        LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
-            << "File handler DecodeLoop";
-        while (running_.load()) {
-            if (!Process()) {
-                break;
+    bool FileHandlerImpl::Step(std::chrono::steady_clock::time_point* next) {
+        if (!prepared_) {
+            prepared_ = true;
+            if (!PrepareResources()) {
+                ClearResources();
+                PostStreamError("Prepare codec resources failed.");
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                    << "PrepareResources failed.";
+                return false;
             }
-            if (framerate_ > 0) controller.Control();
+            StartDemux();
+            if (framerate_ > 0) controller_.Start();
         }
+        if (!running_.load() || !Process()) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "File handler scheduled stream exit.";
+            ClearResources();
+            return false;
+        }
+        if (starved_) {
+            // do not hold a worker while the demux thread reads
+            *next = std::chrono::steady_clock::now() + std::chrono::milliseconds(kStarvedRetryMs);
+        }
+        else if (framerate_ > 0) {
+            *next = controller_.NextDeadline();
+        }
+        return true;
+    }
 
-        LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
-            << "File handler DecoderLoop Exit.";
-        ClearResources();
+    FFParserParam FileHandlerImpl::GetParserParam() const {
+        FFParserParam parser_param;
+        parser_param.use_mmap = param_.use_mmap_;
+        parser_param.probesize = param_.probesize_;
+        parser_param.analyzeduration = param_.analyzeduration_;
+        parser_param.probe_cache = param_.probe_cache_path_;
+        return parser_param;
     }
 
     bool FileHandlerImpl::PrepareResources(bool demux_only) {
         LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
             << "Begin preprare resources";
-        int ret = parser_.Open(filename_, this);
+        FFParserParam parser_param = GetParserParam();
+        if (loop_ && param_.loop_mode_ == LoopMode::LOOP_CACHE) {
+            cache_ = EsPacketCache::Get(filename_, stream_id_, param_.loop_cache_max_bytes_, parser_param);
+            if (cache_) {
+                VideoInfo info = cache_->GetVideoInfo();
+                OnParserInfo(&info);
+                cache_index_ = 0;
+                cache_loops_ = 0;
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                    << "Finish preprare resources, replay packet cache";
+                return !dec_create_failed_;
+            }
+            // fall back to reopen the demuxer
+        }
+        int ret = parser_.Open(filename_, this, parser_param);
         LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
             << "Finish preprare resources";
         if (ret < 0 || dec_create_failed_) {
@@ -136,33 +191,133 @@ namespace easysa {
     void FileHandlerImpl::ClearResources(bool demux_only) {
         LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
             << "Begin clear resources";
+        if (!demux_only) {
+            StopDemux();
+        }
         if (!demux_only && decoder_) {
             decoder_->Destroy();
             decoder_.reset();
+            LogBufferPoolStats();
         }
+        cache_.reset();
         parser_.Close();
         LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
             << "Finish clear resources";
     }
 
+    bool FileHandlerImpl::ProcessCache() {
+        if (cache_index_ == cache_->Size()) {
+            cache_index_ = 0;
+            cache_loops_++;
+        }
+        VideoEsFrame frame;
+        cache_->GetFrame(cache_index_++, &frame);
+        // keep pts increasing over loops
+        frame.pts += cache_loops_ * cache_->GetDuration();
+        OnParserFrame(&frame);
+        if (decode_failed_ || dec_create_failed_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Decode failed";
+            return false;
+        }
+        return true;
+    }
+
+    void FileHandlerImpl::StartDemux() {
+        if (param_.demux_queue_size_ == 0 || cache_) return;  // the cache is replayed from memory
+        packet_queue_.reset(new FrameQueue(param_.demux_queue_size_));
+        discontinuity_ = false;
+        demuxing_ = true;
+        demux_running_.store(1);
+        demux_thread_ = std::thread(&FileHandlerImpl::DemuxLoop, this);
+    }
+
+    void FileHandlerImpl::StopDemux() {
+        demux_running_.store(0);
+        if (demux_thread_.joinable()) {
+            demux_thread_.join();
+        }
+        demuxing_ = false;
+        packet_queue_.reset();
+    }
+
+    void FileHandlerImpl::PushPacket(const std::shared_ptr<EsPacket>& pkt) {
+        while (demux_running_.load()) {
+            if (packet_queue_->Push(kQueueWaitMs, pkt)) return;
+        }
+    }
+
+    void FileHandlerImpl::DemuxLoop() {
+        LOG(INFO) << "[source]:" << "[" << stream_id_ << "]: "
+            << "Demux thread started, read-ahead " << param_.demux_queue_size_ << " packets";
+        while (demux_running_.load()) {
+            parser_.Parse();  // packets are queued by OnParserFrame
+            if (!eos_reached_) continue;
+            eos_reached_ = false;
+            if (this->loop_ && param_.loop_mode_ == LoopMode::LOOP_SEEK && parser_.Rewind() == 0) {
+                discontinuity_ = true;
+                continue;
+            }
+            if (this->loop_) {
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                    << "Loop: reopen demuxer";
+                parser_.Close();
+                if (parser_.Open(filename_, this, GetParserParam()) >= 0) continue;
+                PostStreamError("Prepare codec resources failed");
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                    << "Reopen demuxer failed";
+            }
+            PushPacket(std::make_shared<EsPacket>(nullptr));  // eos
+            break;
+        }
+    }
+
+    bool FileHandlerImpl::ProcessQueue() {
+        std::shared_ptr<EsPacket> pkt;
+        // must not block a shared worker
+        starved_ = !packet_queue_->Pop(0, pkt);
+        if (starved_) return true;
+        if (pkt->pkt_.flags & ESPacket::FLAG_EOS) {
+            if (decoder_) decoder_->Process(nullptr);
+            return false;
+        }
+        if (pkt->discontinuity && decoder_) {
+            decoder_->Flush();
+        }
+        VideoEsFrame frame;
+        frame.data = pkt->pkt_.data;
+        frame.len = pkt->pkt_.size;
+        frame.pts = static_cast<int64_t>(pkt->pkt_.pts);
+        if (pkt->pkt_.flags & ESPacket::FLAG_KEY_FRAME) {
+            frame.flags |= VideoEsFrame::FLAG_KEY_FRAME;
+        }
+        DecodePacket(&frame);
+        if (decode_failed_ || dec_create_failed_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Decode failed";
+            return false;
+        }
+        return true;
+    }
+
     bool FileHandlerImpl::Process() {
+        if (cache_) return ProcessCache();
+        if (demuxing_) return ProcessQueue();
         parser_.Parse();
         if (eos_reached_) {
+            if (this->loop_ && param_.loop_mode_ == LoopMode::LOOP_SEEK && parser_.Rewind() == 0) {
+                // frames before the end are delivered, the decoder starts over with the next key frame
+                if (decoder_) decoder_->Flush();
+                eos_reached_ = false;
+                return true;
+            }
             if (this->loop_) {
                 LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
                     << "Loop: Clear resources and restart";
                 ClearResources(true);
                 if (!PrepareResources(true)) {
                     ClearResources();
-                    if (nullptr != module_) {
-                        Event e;
-                        e.type = EventType::EVENT_STREAM_ERROR;
-                        e.module_name = module_->GetName();
-                        e.message = "Prepare codec resources failed";
-                        e.stream_id = stream_id_;
-                        e.thread_id = std::this_thread::get_id();
-                        module_->PostEvent(e);
-                    }
+                    PostStreamError("Prepare codec resources failed");
                     LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
                         << "PrepareResources failed";
                     return false;
@@ -192,39 +347,20 @@ namespace easysa {
         LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
             << "Got video info.";
         dec_create_failed_ = false;
-        if (param_.decoder_type_ == DecoderType::DECODER_CPU) {
-            decoder_ = std::make_shared<FFmpegCpuDecoder>(stream_id_, this);
-        }
-        else {
-            LOG(ERROR) << "[source]:" << "unsupported decoder_type";
+        decoder_ = CreateDecoder(stream_id_, this, info, param_);
+        if (!decoder_) {
             dec_create_failed_ = true;
+            return;
         }
-        if (decoder_) {
-            ExtraDecoderInfo extra;
-            /*
-            extra.apply_stride_align_for_scaler = param_.input_buf_number_;
-            extra.device_id = param_.device_id_;
-            extra.input_buf_num = param_.input_buf_number_;
-            extra.output_buf_num = param_.output_buf_number_;
-            extra.max_width = 7680;  // FIXME
-            extra.max_height = 4320;  // FIXME
-            */
-            bool ret = decoder_->Create(info, &extra);
-            if (ret != true) {
-                LOG(ERROR) << "[source]:" << "dec_create_failed_";
-                dec_create_failed_ = true;
-                return;
-            }
-            if (info->extra_data.size()) {
-                VideoEsPacket pkt;
-                pkt.data = info->extra_data.data();
-                pkt.len = info->extra_data.size();
-                pkt.pts = 0;
-                if (!decoder_->Process(&pkt)) {
-                    decode_failed_ = true;
-                    LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
-                        << "Decode extra data failed";
-                }
+        if (info->extra_data.size()) {
+            VideoEsPacket pkt;
+            pkt.data = info->extra_data.data();
+            pkt.len = info->extra_data.size();
+            pkt.pts = 0;
+            if (!decoder_->Process(&pkt)) {
+                decode_failed_ = true;
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                    << "Decode extra data failed";
             }
         }
     }
@@ -234,12 +370,99 @@ namespace easysa {
             LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
                 << "eos reached in file handler.";
             eos_reached_ = true;
-            return;  // EOS will be handled in Process()
+            return;  // EOS will be handled in Process() or DemuxLoop()
+        }
+        if (demuxing_) {
+            // called on the demux thread, the packet is decoded by ProcessQueue()
+            ESPacket es_pkt;
+            es_pkt.data = frame->data;
+            es_pkt.size = static_cast<int>(frame->len);
+            es_pkt.pts = static_cast<uint64_t>(frame->pts);
+            if (frame->flags & VideoEsFrame::FLAG_KEY_FRAME) {
+                es_pkt.flags = ESPacket::FLAG_KEY_FRAME;
+            }
+            else if (param_.keyframe_only_) {
+                return;
+            }
+            auto pkt = std::make_shared<EsPacket>(&es_pkt);
+            pkt->discontinuity = discontinuity_;
+            discontinuity_ = false;
+            PushPacket(pkt);
+            return;
+        }
+        DecodePacket(frame);
+    }
+
+    bool FileHandlerImpl::CatchUp(VideoEsFrame* frame) {
+        bool key = (frame->flags & VideoEsFrame::FLAG_KEY_FRAME) != 0;
+        if (skipped_packets_ > 0) {
+            if (!key) {
+                skipped_packets_++;
+                return false;
+            }
+            std::stringstream ss;
+            ss << "skipped " << skipped_packets_ << " packets, resumed at key frame pts " << frame->pts;
+            if (nullptr != module_) {
+                Event e;
+                e.type = EventType::EVENT_STREAM_CATCHUP;
+                e.module_name = module_->GetName();
+                e.message = ss.str();
+                e.stream_id = stream_id_;
+                e.thread_id = std::this_thread::get_id();
+                e.pts = frame->pts;
+                e.count = skipped_packets_;
+                module_->PostEvent(e);
+            }
+            skipped_packets_ = 0;
+            return true;
+        }
+        if (key) return true;  // a key frame is where decoding resumes anyway
+        // frame numbers stand in for missing pts, they tell nothing about the lag
+        if (frame->flags & VideoEsFrame::FLAG_NO_PTS) return true;
+        Pipeline* pipeline = module_ ? module_->GetContainer() : nullptr;
+        if (!pipeline) return true;
+        int64_t output_ts = pipeline->GetStreamOutputTimestamp(stream_id_);
+        if (output_ts < 0) return true;
+        int64_t lag_ms = (frame->pts - output_ts) / 90;  // pts are in 1/90000 second
+        if (lag_ms <= static_cast<int64_t>(param_.max_lag_ms_)) return true;
+
+        LOG(WARNING) << "[source]:" << "[" << stream_id_ << "]: "
+            << "pipeline lags " << lag_ms << " ms behind, skip to the next key frame";
+        // frames buffered in the decoder are as late, drop them too
+        if (decoder_) {
+            discarding_ = true;
+            decoder_->Flush();
+            discarding_ = false;
+        }
+        wanted_pts_.clear();
+        skipped_packets_ = 1;
+        return false;
+    }
+
+    void FileHandlerImpl::DecodePacket(VideoEsFrame* frame) {
+        if (param_.max_lag_ms_ > 0 && !CatchUp(frame)) {
+            return;
         }
         VideoEsPacket pkt;
         pkt.data = frame->data;
         pkt.len = frame->len;
         pkt.pts = frame->pts;
+        if (frame->flags & VideoEsFrame::FLAG_KEY_FRAME) {
+            pkt.flags |= VideoEsPacket::FLAG_KEY_FRAME;
+        }
+        else if (param_.keyframe_only_) {
+            return;  // key frames never reference other frames, so non-key packets are not needed
+        }
+        if (DecimateByPacket()) {
+            if (packet_count_++ % param_.interval_ == 0) {
+                wanted_pts_.insert(pkt.pts);
+                // frames lost by the decoder would stay here forever
+                while (wanted_pts_.size() > kMaxWantedPts) wanted_pts_.erase(wanted_pts_.begin());
+            }
+            else {
+                pkt.flags |= VideoEsPacket::FLAG_DROPPABLE;
+            }
+        }
         /*
         if (module_ && module_->GetProfiler()) {
             auto record_key = std::make_pair(stream_id_, pkt.pts);
@@ -264,7 +487,15 @@ namespace easysa {
     }
 
     void FileHandlerImpl::OnDecodeFrame(DecodeFrame* frame) {
-        if (frame_count_++ % param_.interval_ != 0) {
+        if (discarding_) return;
+        if (DecimateByPacket()) {
+            if (!frame) return;
+            // reference frames of unwanted packets are still decoded, discard them here
+            auto iter = wanted_pts_.find(frame->pts);
+            if (iter == wanted_pts_.end()) return;
+            wanted_pts_.erase(iter);
+        }
+        else if (frame_count_++ % param_.interval_ != 0) {
             return;  // discard frames
         }
         if (!frame) return;
@@ -289,4 +520,28 @@ namespace easysa {
         this->SendFlowEos();
     }
 
+    // ISharedFrameSink methods
+    void FileHandlerImpl::OnSharedFrame(const DataFramePtr& frame, int64_t pts) {
+        if (frame_count_++ % param_.interval_ != 0) {
+            return;  // discard frames
+        }
+        std::shared_ptr<FrameInfo> data = this->CreateFrameInfo(false, frame);
+        if (!data) {
+            return;
+        }
+        data->timestamp = pts;
+        if (!frame) {
+            data->flags = FRAME_FLAG_INVALID;
+        }
+        this->SendFrameInfo(data);
+    }
+
+    void FileHandlerImpl::OnSharedEos() {
+        this->SendFlowEos();
+    }
+
+    void FileHandlerImpl::OnSharedError(const std::string& message) {
+        PostStreamError(message);
+    }
+
 }  // namespace easysa
\ No newline at end of file
@@ -12,6 +12,7 @@
 
 #include <chrono>
 #include <memory>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -19,18 +20,34 @@
 
 #include "data_handler_util.hpp"
 #include "data_source.hpp"
+#include "decode_scheduler.hpp"
+#include "shared_decode.hpp"
 #include "util/video_parser.hpp"
 #include "util/video_decoder.hpp"
+#include "util/packet_cache.hpp"
+#include "util/easysa_frame_pacer.hpp"
 
 namespace easysa {
 
-    class FileHandlerImpl : public IParserResult, public IDecodeResult, public SourceRender {
+    /***********************************************************************
+     * @brief FrController is used to control the frequency of sending data.
+     *
+     * Its deadlines are handed to the DecodeScheduler, no thread sleeps on them.
+     ***********************************************************************/
+    class FrController : public FramePacer {
+    public:
+        FrController() {}
+        explicit FrController(uint32_t frame_rate) : FramePacer(frame_rate) {}
+    };  // class FrController
+
+    class FileHandlerImpl : public IParserResult, public IDecodeResult, public SourceRender, public IScheduledStream,
+        public ISharedFrameSink {
     public:
         explicit FileHandlerImpl(DataSource* module, const std::string& filename, int framerate, bool loop,
             FileHandler* handler)
             :SourceRender(handler), module_(module), filename_(filename),
             framerate_(framerate), loop_(loop), handler_(*handler),
-            stream_id_(handler_.GetStreamId()), parser_(stream_id_) {}
+            stream_id_(handler_.GetStreamId()), controller_(framerate > 0 ? framerate : 0), parser_(stream_id_) {}
         ~FileHandlerImpl() {}
         bool Open();
         void Close();
@@ -45,10 +62,20 @@ namespace easysa {
         DataSourceParam param_;
 
     private:
+        FFParserParam GetParserParam() const;
         bool PrepareResources(bool demux_only = false);
         void ClearResources(bool demux_only = false);
         bool Process();
-        void Loop();
+        void PostStreamError(const std::string& message);
+
+        // IScheduledStream methods, the stream runs on the decode scheduler of the module
+        bool Step(std::chrono::steady_clock::time_point* next) override;
+
+        // ISharedFrameSink methods, used when the module decodes each url once
+        void OnSharedFrame(const DataFramePtr& frame, int64_t pts) override;
+        void OnSharedEos() override;
+        void OnSharedError(const std::string& message) override;
+        std::shared_ptr<SharedDecodeStream> shared_ = nullptr;
 
         // IParserResult methods
         void OnParserInfo(VideoInfo* info) override;
@@ -61,8 +88,10 @@ namespace easysa {
 
         /**/
         std::atomic<int> running_{ 0 };
-        std::thread thread_;
         bool eos_sent_ = false;
+        DecodeScheduler* scheduler_ = nullptr;
+        bool prepared_ = false;
+        FrController controller_;
 
     private:
         FFParser parser_;
@@ -71,45 +100,44 @@ namespace easysa {
         bool decode_failed_ = false;
         bool eos_reached_ = false;
 
+        // decimation by packet, see DataSourceParam::skip_nonref_
+        bool DecimateByPacket() const {
+            return (param_.interval_ > 1 && param_.skip_nonref_) || param_.keyframe_only_;
+        }
+        uint64_t packet_count_ = 0;
+        std::set<int64_t> wanted_pts_;  // pts of packets whose frames will be delivered
+
+        // read-ahead by a demux thread, see DataSourceParam::demux_queue_size_
+        void StartDemux();
+        void StopDemux();
+        void DemuxLoop();
+        void PushPacket(const std::shared_ptr<EsPacket>& pkt);
+        bool ProcessQueue();
+        void DecodePacket(VideoEsFrame* frame);
+        bool demuxing_ = false;
+        bool discontinuity_ = false;  // set by a rewind of the demux thread
+        bool starved_ = false;  // no packet was ready for the last Process()
+        std::atomic<int> demux_running_{ 0 };
+        std::thread demux_thread_;
+        std::unique_ptr<FrameQueue> packet_queue_ = nullptr;
+
+        // catch-up of a lagging stream, see DataSourceParam::max_lag_ms_
+        bool CatchUp(VideoEsFrame* frame);
+        uint64_t skipped_packets_ = 0;  // packets dropped while waiting for the next key frame
+        bool discarding_ = false;  // frames flushed from the decoder are dropped
+
+        // replay of the shared packet cache, see LoopMode::LOOP_CACHE
+        bool ProcessCache();
+        std::shared_ptr<EsPacketCache> cache_ = nullptr;
+        size_t cache_index_ = 0;
+        int64_t cache_loops_ = 0;
+
 #ifdef UNIT_TEST
     public:  // NOLINT
         void SetDecodeParam(const DataSourceParam& param) { param_ = param; }
 #endif
     };  // class FileHandlerImpl
 
-    /***********************************************************************
-     * @brief FrController is used to control the frequency of sending data.
-     ***********************************************************************/
-    class FrController {
-    public:
-        FrController() {}
-        explicit FrController(uint32_t frame_rate) : frame_rate_(frame_rate) {}
-        void Start() { start_ = std::chrono::steady_clock::now(); }
-        void Control() {
-            if (0 == frame_rate_) return;
-            double delay = 1000.0 / frame_rate_;
-            end_ = std::chrono::steady_clock::now();
-            std::chrono::duration<double, std::milli> diff = end_ - start_;
-            auto gap = delay - diff.count() - time_gap_;
-            if (gap > 0) {
-                std::chrono::duration<double, std::milli> dura(gap);
-                std::this_thread::sleep_for(dura);
-                time_gap_ = 0;
-            }
-            else {
-                time_gap_ = -gap;
-            }
-            Start();
-        }
-        inline uint32_t GetFrameRate() const { return frame_rate_; }
-        inline void SetFrameRate(uint32_t frame_rate) { frame_rate_ = frame_rate; }
-
-    private:
-        uint32_t frame_rate_ = 0;
-        double time_gap_ = 0;
-        std::chrono::time_point<std::chrono::steady_clock> start_, end_;
-    };  // class FrController
-
 }  // namespace easysa
 
 #endif // MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_FILE_HPP_
\ No newline at end of file
@@ -0,0 +1,255 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+
+#include "data_handler_file.hpp"
+#include "data_handler_image.hpp"
+
+namespace easysa {
+
+    static constexpr int kDecodeRetryMs = 2;  // the next image is not decoded yet
+
+    std::shared_ptr<SourceHandler> ImageFolderHandler::Create(DataSource* module, const std::string& stream_id,
+        const std::string& path, int framerate) {
+        if (!module || stream_id.empty() || path.empty()) {
+            return nullptr;
+        }
+        std::shared_ptr<ImageFolderHandler> handler(new (std::nothrow) ImageFolderHandler(module, stream_id, path,
+            framerate));
+        return handler;
+    }
+
+    ImageFolderHandler::ImageFolderHandler(DataSource* module, const std::string& stream_id, const std::string& path,
+        int framerate)
+        : SourceHandler(module, stream_id) {
+        impl_ = new (std::nothrow) ImageFolderHandlerImpl(module, path, framerate, this);
+    }
+
+    ImageFolderHandler::~ImageFolderHandler() {
+        if (impl_) {
+            delete impl_;
+        }
+    }
+
+    bool ImageFolderHandler::Open() {
+        if (!this->module_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "module_ null";
+            return false;
+        }
+        if (!impl_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Image folder handler open failed, no memory left";
+            return false;
+        }
+        if (stream_index_ == easysa::INVALID_STREAM_IDX) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Invalid stream_idx";
+            return false;
+        }
+        return impl_->Open();
+    }
+
+    void ImageFolderHandler::Close() {
+        if (impl_) {
+            impl_->Close();
+        }
+    }
+
+    static bool IsImageFile(const std::string& path) {
+        size_t dot = path.rfind('.');
+        if (dot == std::string::npos) return false;
+        std::string ext = path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp" || ext == "tif" || ext == "tiff";
+    }
+
+    bool ImageFolderHandlerImpl::ListImages() {
+        files_.clear();
+        struct stat st;
+        bool is_dir = stat(path_.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+        if (is_dir || path_.find('*') != std::string::npos) {
+            // a directory or a pattern, cv::glob sorts the names
+            std::vector<cv::String> names;
+            try {
+                cv::glob(path_, names, false);
+            }
+            catch (cv::Exception& e) {
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: " << "list images failed: " << e.what();
+                return false;
+            }
+            for (auto& name : names) {
+                if (IsImageFile(name)) files_.push_back(name);
+            }
+        }
+        else {
+            std::ifstream manifest(path_);
+            if (!manifest.is_open()) {
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: " << "open manifest failed -- " << path_;
+                return false;
+            }
+            size_t slash = path_.find_last_of("/\\");
+            std::string dir = slash == std::string::npos ? "" : path_.substr(0, slash + 1);
+            std::string line;
+            while (std::getline(manifest, line)) {
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+                if (line.empty() || line[0] == '#') continue;
+                bool absolute = line[0] == '/' || line[0] == '\\' || (line.size() > 1 && line[1] == ':');
+                files_.push_back(absolute ? line : dir + line);
+            }
+        }
+        if (param_.interval_ > 1) {
+            // unwanted images are never read
+            std::vector<std::string> wanted;
+            for (size_t i = 0; i < files_.size(); i += param_.interval_) wanted.push_back(files_[i]);
+            files_.swap(wanted);
+        }
+        LOG(INFO) << "[source]:" << "[" << stream_id_ << "]: " << files_.size() << " images -- " << path_;
+        return true;
+    }
+
+    bool ImageFolderHandlerImpl::Open() {
+        DataSource* source = dynamic_cast<DataSource*>(module_);
+        param_ = source->GetParam();
+        if (!ListImages()) return false;
+
+        size_t worker_num = param_.image_workers_;
+        if (worker_num == 0) worker_num = std::max(std::thread::hardware_concurrency(), 1u);
+        worker_num = std::max<size_t>(std::min(worker_num, files_.size()), 1);
+        read_ahead_ = param_.image_read_ahead_ ? param_.image_read_ahead_ : 2 * worker_num;
+        read_ahead_ = std::max(read_ahead_, worker_num);
+
+        next_decode_ = 0;
+        delivered_ = 0;
+        decoded_.clear();
+        started_ = false;
+        running_.store(1);
+        for (size_t i = 0; i < worker_num; ++i) {
+            workers_.emplace_back(&ImageFolderHandlerImpl::DecodeLoop, this);
+        }
+        // delivered in order on the workers shared by all streams
+        scheduler_ = source->GetDecodeScheduler();
+        if (!scheduler_ || !scheduler_->Add(this)) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: " << "Schedule stream failed";
+            scheduler_ = nullptr;
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void ImageFolderHandlerImpl::Close() {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            running_.store(0);
+        }
+        cond_.notify_all();
+        if (scheduler_) {
+            scheduler_->Remove(this);
+            scheduler_ = nullptr;
+        }
+        for (auto& worker : workers_) {
+            if (worker.joinable()) worker.join();
+        }
+        workers_.clear();
+        decoded_.clear();
+    }
+
+    void ImageFolderHandlerImpl::DecodeLoop() {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                // read ahead at most read_ahead_ images of the next one delivered
+                cond_.wait(lk, [this]() {
+                    return !running_.load() || next_decode_ >= files_.size() || next_decode_ < delivered_ + read_ahead_;
+                });
+                if (!running_.load() || next_decode_ >= files_.size()) return;
+                index = next_decode_++;
+            }
+            cv::Mat image = cv::imread(files_[index], cv::IMREAD_COLOR);
+            if (image.empty()) {
+                LOG(WARNING) << "[source]:" << "[" << stream_id_ << "]: " << "decode image failed -- " << files_[index];
+            }
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                decoded_[index] = image;
+            }
+            cond_.notify_all();
+        }
+    }
+
+    bool ImageFolderHandlerImpl::Step(std::chrono::steady_clock::time_point* next) {
+        if (!started_) {
+            started_ = true;
+            if (framerate_ > 0) pacer_.Start();
+        }
+        size_t index;
+        cv::Mat image;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (!running_.load()) return false;
+            index = delivered_;
+            if (index < files_.size()) {
+                auto iter = decoded_.find(index);
+                if (iter == decoded_.end()) {
+                    // not decoded yet, a shared worker does not wait for it
+                    *next = std::chrono::steady_clock::now() + std::chrono::milliseconds(kDecodeRetryMs);
+                    return true;
+                }
+                image = iter->second;
+                decoded_.erase(iter);
+                delivered_ = index + 1;
+            }
+        }
+        if (index >= files_.size()) {
+            this->SendFlowEos();
+            return false;
+        }
+        cond_.notify_all();
+        if (image.empty()) return true;  // unreadable images are skipped
+        SendImage(index, image);
+        if (framerate_ > 0) *next = pacer_.NextDeadline();
+        return true;
+    }
+
+    bool ImageFolderHandlerImpl::SendImage(size_t index, cv::Mat image) {
+        std::shared_ptr<FrameInfo> data = this->CreateFrameInfo();
+        if (!data) {
+            return false;
+        }
+        data->timestamp = index;
+        DataFramePtr dataframe = easysa::GetDataFramePtr(data);
+        dataframe->frame_id = frame_id_++;
+        dataframe->fmt = DataFormat::PIXEL_FORMAT_BGR24;
+        dataframe->width = image.cols;
+        dataframe->height = image.rows;
+        dataframe->stride[0] = static_cast<int>(image.step[0] / 3);  // in pixels, see DataFrame::GetPlaneBytes
+        dataframe->ptr_cpu[0] = image.data;
+        dataframe->ctx.dev_type = DevContext::CPU;
+        dataframe->ctx.dev_id = -1;
+        dataframe->ctx.ddr_channel = -1;
+        dataframe->dst_device_id = -1;
+        dataframe->src_mat = image;  // owns the pixels
+        return this->SendFrameInfo(data);
+    }
+
+}  // namespace easysa
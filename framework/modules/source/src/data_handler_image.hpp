@@ -0,0 +1,74 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#ifndef MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_IMAGE_HPP_
+#define MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_IMAGE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glog/logging.h>
+
+#include "data_handler_util.hpp"
+#include "data_source.hpp"
+#include "decode_scheduler.hpp"
+#include "util/easysa_frame_pacer.hpp"
+
+namespace easysa {
+
+    class ImageFolderHandlerImpl : public SourceRender, public IScheduledStream {
+    public:
+        explicit ImageFolderHandlerImpl(DataSource* module, const std::string& path, int framerate,
+            ImageFolderHandler* handler)
+            : SourceRender(handler), module_(module), path_(path), framerate_(framerate),
+            handler_(*handler), stream_id_(handler_.GetStreamId()), pacer_(framerate > 0 ? framerate : 0) {}
+        ~ImageFolderHandlerImpl() {}
+        bool Open();
+        void Close();
+
+    private:
+        DataSource* module_ = nullptr;
+        std::string path_;
+        int framerate_;
+        ImageFolderHandler& handler_;
+        std::string stream_id_;
+        DataSourceParam param_;
+
+    private:
+        bool ListImages();
+        void DecodeLoop();
+        bool SendImage(size_t index, cv::Mat image);
+
+        // IScheduledStream methods, images are delivered on the decode scheduler of the module
+        bool Step(std::chrono::steady_clock::time_point* next) override;
+
+    private:
+        std::vector<std::string> files_;
+        size_t read_ahead_ = 0;
+        // decoded images waiting for delivery, by index in files_
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::map<size_t, cv::Mat> decoded_;
+        size_t next_decode_ = 0;
+        size_t delivered_ = 0;
+        std::atomic<int> running_{ 0 };
+        std::vector<std::thread> workers_;
+        DecodeScheduler* scheduler_ = nullptr;
+        bool started_ = false;
+        FramePacer pacer_;
+    };  // class ImageFolderHandlerImpl
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_IMAGE_HPP_
@@ -0,0 +1,256 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "data_handler_mem.hpp"
+#include "easysa_eventbus.hpp"
+
+namespace easysa {
+
+    static constexpr size_t kMemQueueSize = 32;
+    static constexpr int kQueueWaitMs = 10;
+
+    std::shared_ptr<SourceHandler> ESMemHandler::Create(DataSource* module, const std::string& stream_id) {
+        if (!module || stream_id.empty()) {
+            return nullptr;
+        }
+        std::shared_ptr<ESMemHandler> handler(new (std::nothrow) ESMemHandler(module, stream_id));
+        return handler;
+    }
+
+    ESMemHandler::ESMemHandler(DataSource* module, const std::string& stream_id)
+        : SourceHandler(module, stream_id) {
+        impl_ = new (std::nothrow) ESMemHandlerImpl(module, this);
+    }
+
+    ESMemHandler::~ESMemHandler() {
+        if (impl_) {
+            delete impl_;
+        }
+    }
+
+    bool ESMemHandler::Open() {
+        if (!this->module_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "module_ null";
+            return false;
+        }
+        if (!impl_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "ESMem handler open failed, no memory left";
+            return false;
+        }
+        if (stream_index_ == easysa::INVALID_STREAM_IDX) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Invalid stream_idx";
+            return false;
+        }
+        return impl_->Open();
+    }
+
+    void ESMemHandler::Close() {
+        if (impl_) {
+            impl_->Close();
+        }
+    }
+
+    int ESMemHandler::SetDataType(DataType type) {
+        if (impl_) {
+            return impl_->SetDataType(type);
+        }
+        return -1;
+    }
+
+    int ESMemHandler::Write(ESPacket* pkt) {
+        if (impl_) {
+            return impl_->Write(pkt, nullptr);
+        }
+        return -1;
+    }
+
+    int ESMemHandler::Write(ESPacket* pkt, std::shared_ptr<void> owner) {
+        if (impl_) {
+            return impl_->Write(pkt, owner);
+        }
+        return -1;
+    }
+
+    int ESMemHandlerImpl::SetDataType(ESMemHandler::DataType type) {
+        if (running_.load()) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "SetDataType must be called before Open";
+            return -1;
+        }
+        if (type != ESMemHandler::H264 && type != ESMemHandler::H265) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "unsupported data type";
+            return -1;
+        }
+        data_type_ = type;
+        return 0;
+    }
+
+    bool ESMemHandlerImpl::Open() {
+        DataSource* source = dynamic_cast<DataSource*>(module_);
+        param_ = source->GetParam();
+        if (data_type_ == ESMemHandler::INVALID) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "data type not set";
+            return false;
+        }
+        VideoInfo info;
+        info.codec_id = data_type_ == ESMemHandler::H264 ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC;
+        info.progressive = 1;
+        decoder_ = CreateDecoder(stream_id_, this, &info, param_);
+        if (!decoder_) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Create decoder failed";
+            return false;
+        }
+        queue_.reset(new FrameQueue(kMemQueueSize));
+        eos_written_.store(false);
+        loop_exited_.store(false);
+        running_.store(1);
+        thread_ = std::thread(&ESMemHandlerImpl::DecodeLoop, this);
+        return true;
+    }
+
+    void ESMemHandlerImpl::Close() {
+        if (running_.load()) {
+            running_.store(0);
+            if (thread_.joinable()) {
+                thread_.join();
+            }
+        }
+        if (decoder_) {
+            decoder_->Destroy();
+            decoder_.reset();
+            LogBufferPoolStats();
+        }
+        // a writer still in Push() holds write_mutex_ until it sees running_ cleared
+        std::lock_guard<std::mutex> lk(write_mutex_);
+        queue_.reset();
+    }
+
+    bool ESMemHandlerImpl::Push(const std::shared_ptr<EsPacket>& pkt) {
+        while (running_.load() && !loop_exited_.load()) {
+            if (queue_->Push(kQueueWaitMs, pkt)) return true;
+        }
+        return false;
+    }
+
+    int ESMemHandlerImpl::Write(ESPacket* pkt, std::shared_ptr<void> owner) {
+        std::lock_guard<std::mutex> lk(write_mutex_);
+        if (!running_.load() || loop_exited_.load() || eos_written_.load()) return -1;
+        if (pkt && pkt->data && pkt->size > 0) {
+            std::shared_ptr<EsPacket> es_pkt = owner ? std::make_shared<EsPacket>(pkt, owner)
+                : std::make_shared<EsPacket>(pkt);
+            if (!es_pkt->pkt_.data) {
+                LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                    << "Write failed, no memory left";
+                return -1;
+            }
+            es_pkt->pkt_.flags &= ~ESPacket::FLAG_EOS;
+            if (!Push(es_pkt)) return -1;
+        }
+        if (!pkt || (pkt->flags & ESPacket::FLAG_EOS)) {
+            eos_written_.store(true);
+            if (!Push(std::make_shared<EsPacket>(nullptr))) return -1;
+        }
+        return 0;
+    }
+
+    void ESMemHandlerImpl::PostStreamError(const std::string& message) {
+        if (nullptr != module_) {
+            Event e;
+            e.type = EventType::EVENT_STREAM_ERROR;
+            e.module_name = module_->GetName();
+            e.message = message;
+            e.stream_id = stream_id_;
+            e.thread_id = std::this_thread::get_id();
+            module_->PostEvent(e);
+        }
+    }
+
+    void ESMemHandlerImpl::DecodeLoop() {
+        while (running_.load()) {
+            std::shared_ptr<EsPacket> pkt;
+            if (!queue_->Pop(kQueueWaitMs, pkt)) continue;
+            if (Process(pkt)) continue;
+            if (!(pkt->pkt_.flags & ESPacket::FLAG_EOS)) {
+                // the decoder failed, downstream would wait for this stream forever
+                PostStreamError("Decode failed");
+                this->SendFlowEos();
+            }
+            break;
+        }
+        loop_exited_.store(true);
+        LOG(INFO) << "[source]:" << "[" << stream_id_ << "]: "
+            << "ESMem handler decode loop exit.";
+    }
+
+    bool ESMemHandlerImpl::Process(const std::shared_ptr<EsPacket>& pkt) {
+        if (pkt->pkt_.flags & ESPacket::FLAG_EOS) {
+            decoder_->Process(nullptr);
+            return false;
+        }
+        VideoEsPacket es_pkt;
+        es_pkt.data = pkt->pkt_.data;
+        es_pkt.len = pkt->pkt_.size;
+        es_pkt.pts = static_cast<int64_t>(pkt->pkt_.pts);
+        es_pkt.owner = pkt->owner_;
+        if (pkt->pkt_.flags & ESPacket::FLAG_KEY_FRAME) {
+            es_pkt.flags |= VideoEsPacket::FLAG_KEY_FRAME;
+        }
+        if (!decoder_->Process(&es_pkt)) {
+            LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+                << "Decode failed";
+            return false;
+        }
+        return true;
+    }
+
+    // IDecodeResult methods
+    void ESMemHandlerImpl::OnDecodeError(DecodeErrorCode error_code) {
+        LOG(ERROR) << "[source]:" << "[" << stream_id_ << "]: "
+            << "ESMemHandlerImpl::OnDecodeError() called";
+        interrupt_.store(true);
+    }
+
+    void ESMemHandlerImpl::OnDecodeFrame(DecodeFrame* frame) {
+        if (!frame) return;
+        if (frame_count_++ % param_.interval_ != 0) {
+            return;  // discard frames
+        }
+        std::shared_ptr<FrameInfo> data = this->CreateFrameInfo();
+        if (!data) {
+            return;
+        }
+        data->timestamp = frame->pts;
+        if (!frame->valid) {
+            data->flags = FRAME_FLAG_INVALID;
+            this->SendFrameInfo(data);
+            return;
+        }
+        int ret = SourceRender::Process(data, frame, frame_id_++, param_);
+        if (ret < 0) {
+            return;
+        }
+        this->SendFrameInfo(data);
+    }
+
+    void ESMemHandlerImpl::OnDecodeEos() {
+        this->SendFlowEos();
+    }
+
+}  // namespace easysa
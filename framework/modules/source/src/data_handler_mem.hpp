@@ -0,0 +1,66 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#ifndef MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_MEM_HPP_
+#define MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_MEM_HPP_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <glog/logging.h>
+
+#include "data_handler_util.hpp"
+#include "data_source.hpp"
+#include "util/video_decoder.hpp"
+
+namespace easysa {
+
+    class ESMemHandlerImpl : public IDecodeResult, public SourceRender {
+    public:
+        explicit ESMemHandlerImpl(DataSource* module, ESMemHandler* handler)
+            : SourceRender(handler), module_(module), handler_(*handler), stream_id_(handler_.GetStreamId()) {}
+        ~ESMemHandlerImpl() {}
+        bool Open();
+        void Close();
+        int SetDataType(ESMemHandler::DataType type);
+        int Write(ESPacket* pkt, std::shared_ptr<void> owner);
+
+    private:
+        DataSource* module_ = nullptr;
+        ESMemHandler& handler_;
+        std::string stream_id_;
+        DataSourceParam param_;
+        ESMemHandler::DataType data_type_ = ESMemHandler::INVALID;
+
+    private:
+        bool Push(const std::shared_ptr<EsPacket>& pkt);
+        void DecodeLoop();
+        bool Process(const std::shared_ptr<EsPacket>& pkt);
+        void PostStreamError(const std::string& message);
+
+        // IDecodeResult methods
+        void OnDecodeError(DecodeErrorCode error_code) override;
+        void OnDecodeFrame(DecodeFrame* frame) override;
+        void OnDecodeEos() override;
+
+    private:
+        std::atomic<int> running_{ 0 };
+        std::atomic<bool> eos_written_{ false };
+        std::atomic<bool> loop_exited_{ false };  // the decode loop stopped on eos or an error, writes fail
+        std::mutex write_mutex_;  // keeps packets of concurrent writers whole and in order
+        std::unique_ptr<FrameQueue> queue_ = nullptr;
+        std::thread thread_;
+        std::shared_ptr<Decoder> decoder_ = nullptr;
+    };  // class ESMemHandlerImpl
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_DATA_SOURCE_HANDLER_MEM_HPP_
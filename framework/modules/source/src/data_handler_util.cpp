@@ -10,17 +10,187 @@
 #include "data_handler_util.hpp"
 
 #include "libyuv.h"
+#include <algorithm>
 #include <memory>
 
 namespace easysa {
 
     // #define DEBUG_DUMP_IMAGE 1
 
+    /*
+    * holds the decoder buffer referenced by the planes of a DataFrame
+    */
+    class DecBufDeallocator : public IDataDeallocator {
+    public:
+        explicit DecBufDeallocator(IDecBufRef* ptr) {
+            ptr_.reset(ptr);
+        }
+        ~DecBufDeallocator() = default;
+
+    private:
+        std::unique_ptr<IDecBufRef> ptr_;
+    };
+
+    std::shared_ptr<Decoder> CreateDecoder(const std::string& stream_id, IDecodeResult* result, VideoInfo* info,
+        const DataSourceParam& param) {
+        std::shared_ptr<Decoder> decoder = nullptr;
+        if (param.decoder_type_ == DecoderType::DECODER_CPU) {
+            decoder = std::make_shared<FFmpegCpuDecoder>(stream_id, result);
+        }
+        else {
+            LOG(ERROR) << "[source]:" << "unsupported decoder_type";
+            return nullptr;
+        }
+        ExtraDecoderInfo extra;
+        /*
+        extra.apply_stride_align_for_scaler = param.input_buf_number_;
+        extra.device_id = param.device_id_;
+        extra.input_buf_num = param.input_buf_number_;
+        extra.output_buf_num = param.output_buf_number_;
+        extra.max_width = 7680;  // FIXME
+        extra.max_height = 4320;  // FIXME
+        */
+        extra.decoder_threads = param.decoder_threads_;
+        switch (param.thread_type_) {
+        case DecoderThreadType::DECODER_THREAD_FRAME:
+            extra.thread_type = FF_THREAD_FRAME;
+            break;
+        case DecoderThreadType::DECODER_THREAD_SLICE:
+            extra.thread_type = FF_THREAD_SLICE;
+            break;
+        default:
+            extra.thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            break;
+        }
+        extra.keep_frame_ref = (param.output_format_ == OutputFormat::OUTPUT_FORMAT_I420);
+        extra.keyframe_only = param.keyframe_only_;
+        if (decoder->Create(info, &extra) != true) {
+            LOG(ERROR) << "[source]:" << "dec_create_failed_";
+            return nullptr;
+        }
+        return decoder;
+    }
+
+    /*
+    * the analysis resolution of a frame, never larger than the source.
+    * Sizes are even as required by the 4:2:0 chroma planes.
+    */
+    static void GetOutputSize(const DataSourceParam& param, int src_width, int src_height,
+        int* out_width, int* out_height) {
+        *out_width = src_width;
+        *out_height = src_height;
+        if (param.output_width_ == 0 && param.output_height_ == 0) return;
+        double scale_w = param.output_width_ ? 1.0 * param.output_width_ / src_width : 1.0;
+        double scale_h = param.output_height_ ? 1.0 * param.output_height_ / src_height : 1.0;
+        if (param.keep_aspect_) {
+            scale_w = scale_h = std::min(std::min(scale_w, scale_h), 1.0);
+        }
+        else {
+            scale_w = std::min(scale_w, 1.0);
+            scale_h = std::min(scale_h, 1.0);
+        }
+        if (scale_w < 1.0) *out_width = std::max(static_cast<int>(src_width * scale_w) & ~1, 2);
+        if (scale_h < 1.0) *out_height = std::max(static_cast<int>(src_height * scale_h) & ~1, 2);
+    }
+
+    int SourceRender::ScaleToNV12(DataFramePtr dataframe, DecodeFrame* frame, int out_width, int out_height,
+        const DataSourceParam& param_) {
+        const int src_width = frame->width;
+        const int src_height = frame->height;
+        const int full_stride = (src_width + 1) & ~1;
+        const size_t full_y_bytes = static_cast<size_t>(full_stride) * src_height;
+        const size_t full_bytes = full_y_bytes + static_cast<size_t>(full_stride) * ((src_height + 1) / 2);
+
+        // full resolution NV12 is needed for YUYV input, or when it is kept with the frame
+        uint8_t* full_y = nullptr;
+        if (param_.keep_full_res_ || frame->fmt == DecodeFrame::FMT_YUYV) {
+            if (param_.keep_full_res_) {
+                if (!full_pool_) {
+                    full_pool_ = FrameBufferPool::Create(param_.output_buf_number_, param_.frame_allocator_);
+                }
+                dataframe->full_cpu_data = full_pool_ ? full_pool_->GetBuffer(full_bytes) : nullptr;
+                if (nullptr == dataframe->full_cpu_data) {
+                    LOG(ERROR) << "source" << "failed to alloc cpu memory";
+                    return -1;
+                }
+                full_y = static_cast<uint8_t*>(dataframe->full_cpu_data.get());
+            }
+            else {
+                scale_buf_.resize(full_bytes);
+                full_y = scale_buf_.data();
+            }
+            uint8_t* full_uv = full_y + full_y_bytes;
+            if (frame->fmt == DecodeFrame::FMT_YUYV) {
+                libyuv::YUY2ToNV12(static_cast<uint8_t*>(frame->plane[0]), frame->stride[0],
+                    full_y, full_stride, full_uv, full_stride, src_width, src_height);
+            }
+            else {
+                libyuv::I420ToNV12(static_cast<uint8_t*>(frame->plane[0]), frame->stride[0],
+                    static_cast<uint8_t*>(frame->plane[1]), frame->stride[1],
+                    static_cast<uint8_t*>(frame->plane[2]), frame->stride[2],
+                    full_y, full_stride, full_uv, full_stride, src_width, src_height);
+            }
+            if (param_.keep_full_res_) {
+                dataframe->full_width = src_width;
+                dataframe->full_height = src_height;
+                dataframe->full_stride[0] = dataframe->full_stride[1] = full_stride;
+                dataframe->full_ptr_cpu[0] = full_y;
+                dataframe->full_ptr_cpu[1] = full_uv;
+            }
+        }
+
+        dataframe->width = out_width;
+        dataframe->height = out_height;
+        dataframe->stride[0] = out_width;
+        dataframe->stride[1] = out_width;
+        size_t bytes = dataframe->GetBytes();
+        if (!pool_) {
+            pool_ = FrameBufferPool::Create(param_.output_buf_number_, param_.frame_allocator_);
+        }
+        dataframe->cpu_data = pool_ ? pool_->GetBuffer(bytes) : nullptr;
+        if (nullptr == dataframe->cpu_data) {
+            LOG(ERROR) << "source" << "failed to alloc cpu memory";
+            return -1;
+        }
+        uint8_t* dst_y = static_cast<uint8_t*>(dataframe->cpu_data.get());
+        uint8_t* dst_uv = dst_y + dataframe->GetPlaneBytes(0);
+
+        if (full_y) {
+            libyuv::NV12Scale(full_y, full_stride, full_y + full_y_bytes, full_stride, src_width, src_height,
+                dst_y, dataframe->stride[0], dst_uv, dataframe->stride[1], out_width, out_height,
+                libyuv::kFilterBox);
+            return 0;
+        }
+
+        // I420 input: scale the planar frame first, so only the small frame is interleaved
+        const int half_width = (out_width + 1) / 2;
+        const int half_height = (out_height + 1) / 2;
+        const size_t y_bytes = static_cast<size_t>(out_width) * out_height;
+        const size_t c_bytes = static_cast<size_t>(half_width) * half_height;
+        scale_buf_.resize(y_bytes + 2 * c_bytes);
+        uint8_t* tmp_y = scale_buf_.data();
+        uint8_t* tmp_u = tmp_y + y_bytes;
+        uint8_t* tmp_v = tmp_u + c_bytes;
+        libyuv::I420Scale(static_cast<uint8_t*>(frame->plane[0]), frame->stride[0],
+            static_cast<uint8_t*>(frame->plane[1]), frame->stride[1],
+            static_cast<uint8_t*>(frame->plane[2]), frame->stride[2],
+            src_width, src_height,
+            tmp_y, out_width, tmp_u, half_width, tmp_v, half_width,
+            out_width, out_height, libyuv::kFilterBox);
+        libyuv::I420ToNV12(tmp_y, out_width, tmp_u, half_width, tmp_v, half_width,
+            dst_y, dataframe->stride[0], dst_uv, dataframe->stride[1], out_width, out_height);
+        return 0;
+    }
+
     int SourceRender::Process(std::shared_ptr<FrameInfo> frame_info,
         DecodeFrame* frame, uint64_t frame_id, const DataSourceParam& param_) {
         DataFramePtr dataframe = easysa::GetDataFramePtr(frame_info);
         if (!dataframe) return -1;
+        return Process(dataframe, frame, frame_id, param_);
+    }
 
+    int SourceRender::Process(DataFramePtr dataframe,
+        DecodeFrame* frame, uint64_t frame_id, const DataSourceParam& param_) {
         dataframe->frame_id = frame_id;
         /*fill source data info*/
         dataframe->width = frame->width;
@@ -69,8 +239,9 @@ namespace easysa {
                 */
             }
             else {
-                dataframe->dst_device_id = -1;  // unused
-                dataframe->CopyToSyncMem(false);
+                // copying device frames to cpu went with SyncedMemory
+                LOG(ERROR) << "[source]: " << "output_type cpu is not supported for frames decoded to cuda";
+                return -1;
             }
 
 #ifdef DEBUG_DUMP_IMAGE
@@ -91,100 +262,103 @@ namespace easysa {
             return -1;
         }
 
-        // we use NV21 as source output-format
-        dataframe->fmt = DataFormat::PIXEL_FORMAT_YUV420_NV12;
-
         // convert to cpu first always
         dataframe->ctx.dev_type = DevContext::CPU;
         dataframe->ctx.dev_id = -1;
         dataframe->ctx.ddr_channel = -1;  // unused for cpu
-        dataframe->stride[0] = frame->stride[0];
-        dataframe->stride[1] = frame->stride[0];
 
-        size_t bytes = dataframe->GetBytes();
-        bytes = ROUND_UP(bytes, 64 * 1024);
-        dataframe->cpu_data = CpuMemAlloc(bytes);
-        if (nullptr == dataframe->cpu_data) {
-            LOG(ERROR) << "source" << "failed to alloc cpu memory";
-            return -1;
-        }
+        int out_width = frame->width;
+        int out_height = frame->height;
+        GetOutputSize(param_, frame->width, frame->height, &out_width, &out_height);
+        bool scaling = (out_width != frame->width || out_height != frame->height);
 
-        switch (frame->fmt) {
-        case DecodeFrame::FMT_I420:
-        case DecodeFrame::FMT_J420: {
-            uint8_t* dst_y = static_cast<uint8_t*>(dataframe->cpu_data.get());
-            uint8_t* dst_uv = dst_y + dataframe->GetPlaneBytes(0);
-            libyuv::I420ToNV12(static_cast<uint8_t*>(frame->plane[0]),
-                frame->stride[0],
-                static_cast<uint8_t*>(frame->plane[1]),
-                frame->stride[1],
-                static_cast<uint8_t*>(frame->plane[2]),
-                frame->stride[2],
-                dst_y,
-                dataframe->stride[0],
-                dst_uv,
-                dataframe->stride[1],
-                dataframe->width,
-                dataframe->height);
-            break;
-        }
-        case DecodeFrame::FMT_YUYV: {
-            int tmp_stride = (frame->width + 1) / 2 * 2;
-            int tmp_height = (frame->height + 1) / 2 * 2;
-            std::unique_ptr<uint8_t[]> tmp_i420_y(new uint8_t[tmp_stride * tmp_height]);
-            std::unique_ptr<uint8_t[]> tmp_i420_u(new uint8_t[tmp_stride * tmp_height / 4]);
-            std::unique_ptr<uint8_t[]> tmp_i420_v(new uint8_t[tmp_stride * tmp_height / 4]);
-
-            libyuv::YUY2ToI420(static_cast<uint8_t*>(frame->plane[0]),
-                frame->stride[0],
-                tmp_i420_y.get(),
-                tmp_stride,
-                tmp_i420_u.get(),
-                tmp_stride / 2,
-                tmp_i420_v.get(),
-                tmp_stride / 2,
-                frame->width,
-                frame->height);
-
-            uint8_t* dst_y = static_cast<uint8_t*>(dataframe->cpu_data.get());
-            uint8_t* dst_uv = dst_y + dataframe->GetPlaneBytes(0);
-            libyuv::I420ToNV12(tmp_i420_y.get(),
-                tmp_stride,
-                tmp_i420_u.get(),
-                tmp_stride / 2,
-                tmp_i420_v.get(),
-                tmp_stride / 2,
-                dst_y,
-                dataframe->stride[0],
-                dst_uv,
-                dataframe->stride[1],
-                dataframe->width,
-                dataframe->height);
-            break;
+        // I420 passthrough, planes point into the decoder buffer which is kept alive with the frame
+        if (!scaling && OUTPUT_FORMAT_I420 == param_.output_format_ && OUTPUT_CPU == param_.output_type_ && frame->buf_ref
+            && (frame->fmt == DecodeFrame::FMT_I420 || frame->fmt == DecodeFrame::FMT_J420)) {
+            dataframe->fmt = DataFormat::PIXEL_FORMAT_YUV420_I420;
+            for (int i = 0; i < dataframe->GetPlanes(); i++) {
+                dataframe->stride[i] = frame->stride[i];
+                dataframe->ptr_cpu[i] = frame->plane[i];
+            }
+            dataframe->deAllocator_.reset(new DecBufDeallocator(frame->buf_ref.release()));
+            dataframe->dst_device_id = -1;
+            return 0;
         }
-        default: {
-            LOG(ERROR) << "[source]: " << "Should not come here";
-            return -1;
+
+        // we use NV12 as source output-format
+        dataframe->fmt = DataFormat::PIXEL_FORMAT_YUV420_NV12;
+        if (scaling) {
+            if (ScaleToNV12(dataframe, frame, out_width, out_height, param_) < 0) {
+                return -1;
+            }
         }
+        else {
+            dataframe->stride[0] = frame->stride[0];
+            dataframe->stride[1] = frame->stride[0];
+
+            size_t bytes = dataframe->GetBytes();
+            bytes = ROUND_UP(bytes, 64 * 1024);
+            if (!pool_) {
+                pool_ = FrameBufferPool::Create(param_.output_buf_number_, param_.frame_allocator_);
+            }
+            dataframe->cpu_data = pool_ ? pool_->GetBuffer(bytes) : nullptr;
+            if (nullptr == dataframe->cpu_data) {
+                LOG(ERROR) << "source" << "failed to alloc cpu memory";
+                return -1;
+            }
+
+            switch (frame->fmt) {
+            case DecodeFrame::FMT_I420:
+            case DecodeFrame::FMT_J420: {
+                uint8_t* dst_y = static_cast<uint8_t*>(dataframe->cpu_data.get());
+                uint8_t* dst_uv = dst_y + dataframe->GetPlaneBytes(0);
+                libyuv::I420ToNV12(static_cast<uint8_t*>(frame->plane[0]),
+                    frame->stride[0],
+                    static_cast<uint8_t*>(frame->plane[1]),
+                    frame->stride[1],
+                    static_cast<uint8_t*>(frame->plane[2]),
+                    frame->stride[2],
+                    dst_y,
+                    dataframe->stride[0],
+                    dst_uv,
+                    dataframe->stride[1],
+                    dataframe->width,
+                    dataframe->height);
+                break;
+            }
+            case DecodeFrame::FMT_YUYV: {
+                uint8_t* dst_y = static_cast<uint8_t*>(dataframe->cpu_data.get());
+                uint8_t* dst_uv = dst_y + dataframe->GetPlaneBytes(0);
+                libyuv::YUY2ToNV12(static_cast<uint8_t*>(frame->plane[0]),
+                    frame->stride[0],
+                    dst_y,
+                    dataframe->stride[0],
+                    dst_uv,
+                    dataframe->stride[1],
+                    dataframe->width,
+                    dataframe->height);
+                break;
+            }
+            default: {
+                LOG(ERROR) << "[source]: " << "Should not come here";
+                return -1;
+            }
+            }
         }
 
-        // fill data to dataframe
-        void* dst = dataframe->cpu_data.get();
+        // fill data to dataframe, the planes lie one after another in cpu_data
+        uint8_t* dst = static_cast<uint8_t*>(dataframe->cpu_data.get());
         for (int i = 0; i < dataframe->GetPlanes(); i++) {
-            size_t plane_size = dataframe->GetPlaneBytes(i);
-            // dataframe->data[i].reset(new SyncedMemory(plane_size));
-            dataframe->data[i]->SetCpuData(dst);
-            dst = reinterpret_cast<void*>(reinterpret_cast<uint8_t*>(dst) + plane_size);
+            dataframe->ptr_cpu[i] = dst;
+            dst += dataframe->GetPlaneBytes(i);
         }
 
-        // sync memory from cpu if needed
+        // frames decoded to cpu are not copied to cuda memory, there is no SyncedMemory to do it
         if (OUTPUT_CUDA == param_.output_type_) {
-            dataframe->dst_device_id = param_.device_id_;  // assume the param_.device_id is dst_device_id
-            for (int i = 0; i < dataframe->GetPlanes(); i++) {
-                dataframe->data[i]->SetCUDADevContext(dataframe->dst_device_id);
-                dataframe->data[i]->GetCUDAData();
-            }
+            LOG(ERROR) << "[source]: " << "output_type cuda is not supported for frames decoded to cpu";
+            return -1;
         }
+        dataframe->dst_device_id = -1;
 
 #ifdef DEBUG_DUMP_IMAGE
         static bool flag = false;
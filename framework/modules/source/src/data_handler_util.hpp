@@ -20,19 +20,25 @@
 #include <iostream>
 #include <thread>
 #include <string>
+#include <vector>
 #include <glog/logging.h>
 #include "easysa_frame_va.hpp"
 #include "data_source.hpp"
 #include "util/video_decoder.hpp"
+#include "util/frame_buffer_pool.hpp"
 
 namespace easysa {
 
+    // zeroed bytes after copied packet data, as required by the FFmpeg parsers and decoders
+    static constexpr int kEsPacketPadding = 64;
+
     struct EsPacket {
         explicit EsPacket(ESPacket* pkt) {
             if (pkt && pkt->data && pkt->size) {
-                pkt_.data = new(std::nothrow) unsigned char[pkt->size];
+                pkt_.data = new(std::nothrow) unsigned char[pkt->size + kEsPacketPadding];
                 if (pkt_.data) {
                     memcpy(pkt_.data, pkt->data, pkt->size);
+                    memset(pkt_.data + pkt->size, 0, kEsPacketPadding);
                     pkt_.size = pkt->size;
                 }
                 else {
@@ -49,8 +55,15 @@ namespace easysa {
             }
         }
 
+        /*
+        * references the packet data without copying, owner keeps it alive
+        */
+        EsPacket(ESPacket* pkt, std::shared_ptr<void> owner) : owner_(owner) {
+            pkt_ = *pkt;
+        }
+
         ~EsPacket() {
-            if (pkt_.data) {
+            if (pkt_.data && !owner_) {
                 delete[]pkt_.data, pkt_.data = nullptr;
             }
             pkt_.size = 0;
@@ -59,6 +72,8 @@ namespace easysa {
         }
 
         ESPacket pkt_;
+        std::shared_ptr<void> owner_ = nullptr;
+        bool discontinuity = false;  // first packet after a seek, the decoder is flushed before it
     };
 
     template<typename T>
@@ -136,13 +151,19 @@ namespace easysa {
     };
     using FrameQueue = BoundedQueue<std::shared_ptr<EsPacket>>;
 
+    /*
+    * creates and opens the decoder configured by the source params, nullptr on failure
+    */
+    std::shared_ptr<Decoder> CreateDecoder(const std::string& stream_id, IDecodeResult* result, VideoInfo* info,
+        const DataSourceParam& param);
+
     class SourceRender {
     public:
         explicit SourceRender(SourceHandler* handler) : handler_(handler) {}
         virtual ~SourceRender() = default;
 
         virtual bool CreateInterrupt() { return interrupt_.load(); }
-        std::shared_ptr<FrameInfo> CreateFrameInfo(bool eos = false) {
+        std::shared_ptr<FrameInfo> CreateFrameInfo(bool eos = false, DataFramePtr frame = nullptr) {
             std::shared_ptr<FrameInfo> data;
             while (1) {
                 data = handler_->CreateFrameInfo(eos);
@@ -150,7 +171,7 @@ namespace easysa {
                 if (CreateInterrupt()) break;
                 std::this_thread::sleep_for(std::chrono::microseconds(5));
             }
-            auto dataframe = std::make_shared<DataFrame>();
+            auto dataframe = frame ? frame : std::make_shared<DataFrame>();
             if (!dataframe) {
                 return nullptr;
             }
@@ -186,6 +207,15 @@ namespace easysa {
             return handler_->SendData(data);
         }
 
+        void LogBufferPoolStats() {
+            if (!pool_ || !handler_) return;
+            FrameBufferPoolStats stats = pool_->GetStats();
+            LOG(INFO) << "[source]:" << "[" << handler_->GetStreamId() << "]: "
+                << "output buffer pool: size " << stats.buffer_size << ", capacity " << stats.capacity
+                << ", high water mark " << stats.high_water_mark << ", allocated " << stats.allocated
+                << ", reused " << stats.reused;
+        }
+
     protected:
         SourceHandler* handler_;
         bool eos_sent_ = false;
@@ -194,9 +224,21 @@ namespace easysa {
         std::atomic<bool> interrupt_{ false };
         uint64_t frame_count_ = 0;
         uint64_t frame_id_ = 0;
+        std::shared_ptr<FrameBufferPool> pool_ = nullptr;  // cpu output buffers, created on first frame
+        std::shared_ptr<FrameBufferPool> full_pool_ = nullptr;  // full resolution buffers kept with scaled frames
+        std::vector<uint8_t> scale_buf_;  // scratch planes for scaling, reused by every frame
+
+    private:
+        int ScaleToNV12(DataFramePtr dataframe, DecodeFrame* frame, int out_width, int out_height,
+            const DataSourceParam& param_);
 
     public:
-        static int Process(std::shared_ptr<FrameInfo> frame_info,
+        int Process(std::shared_ptr<FrameInfo> frame_info,
+            DecodeFrame* frame, uint64_t frame_id, const DataSourceParam& param_);
+        /*
+        * fills the DataFrame only, for frames not bound to one stream
+        */
+        int Process(DataFramePtr dataframe,
             DecodeFrame* frame, uint64_t frame_id, const DataSourceParam& param_);
     };
 
@@ -15,9 +15,13 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <glog/logging.h>
 
+#include "decode_scheduler.hpp"
+#include "shared_decode.hpp"
 #include "profiler/module_profiler.hpp"
+#include "util/video_decoder.hpp"
 
 namespace easysa {
 
@@ -35,6 +39,21 @@ namespace easysa {
         return device_id;
     }
 
+    static bool GetBoolParam(ModuleParamSet paramSet, const std::string& key, bool* value) {
+        std::string str = paramSet[key];
+        if (str == "true" || str == "1") {
+            *value = true;
+        }
+        else if (str == "false" || str == "0") {
+            *value = false;
+        }
+        else {
+            LOG(ERROR) << "[source]:" << key << " : invalid, should be true or false";
+            return false;
+        }
+        return true;
+    }
+
     bool DataSource::Open(ModuleParamSet paramSet) {
         if (paramSet.find("output_type") != paramSet.end()) {
             std::string out_type = paramSet["output_type"];
@@ -57,6 +76,56 @@ namespace easysa {
             }
         }
 
+        if (paramSet.find("output_format") != paramSet.end()) {
+            std::string out_fmt = paramSet["output_format"];
+            if (out_fmt == "nv12") {
+                param_.output_format_ = OUTPUT_FORMAT_NV12;
+            }
+            else if (out_fmt == "i420") {
+                param_.output_format_ = OUTPUT_FORMAT_I420;
+            }
+            else {
+                LOG(ERROR) << "[source]:" << "output_format " << out_fmt << " not supported";
+                return false;
+            }
+            if (param_.output_format_ == OUTPUT_FORMAT_I420 && param_.output_type_ != OUTPUT_CPU) {
+                LOG(WARNING) << "[source]:" << "output_format i420 only works with output_type cpu, use nv12";
+                param_.output_format_ = OUTPUT_FORMAT_NV12;
+            }
+        }
+
+        if (paramSet.find("output_width") != paramSet.end()) {
+            std::stringstream ss;
+            int width = -1;
+            ss << paramSet["output_width"];
+            ss >> width;
+            if (width < 0) {
+                LOG(ERROR) << "[source]:" << "output_width : invalid";
+                return false;
+            }
+            param_.output_width_ = width;
+        }
+
+        if (paramSet.find("output_height") != paramSet.end()) {
+            std::stringstream ss;
+            int height = -1;
+            ss << paramSet["output_height"];
+            ss >> height;
+            if (height < 0) {
+                LOG(ERROR) << "[source]:" << "output_height : invalid";
+                return false;
+            }
+            param_.output_height_ = height;
+        }
+
+        if (paramSet.find("keep_aspect") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "keep_aspect", &param_.keep_aspect_)) return false;
+        }
+
+        if (paramSet.find("keep_full_res") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "keep_full_res", &param_.keep_full_res_)) return false;
+        }
+
         if (paramSet.find("interval") != paramSet.end()) {
             std::stringstream ss;
             int interval;
@@ -69,6 +138,144 @@ namespace easysa {
             param_.interval_ = interval;
         }
 
+        if (paramSet.find("skip_nonref") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "skip_nonref", &param_.skip_nonref_)) return false;
+        }
+
+        if (paramSet.find("keyframe_only") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "keyframe_only", &param_.keyframe_only_)) return false;
+        }
+
+        if (paramSet.find("use_mmap") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "use_mmap", &param_.use_mmap_)) return false;
+        }
+
+        if (paramSet.find("shared_decode") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "shared_decode", &param_.shared_decode_)) return false;
+        }
+
+        if (paramSet.find("loop_mode") != paramSet.end()) {
+            std::string loop_mode = paramSet["loop_mode"];
+            if (loop_mode == "reopen") {
+                param_.loop_mode_ = LOOP_REOPEN;
+            }
+            else if (loop_mode == "cache") {
+                param_.loop_mode_ = LOOP_CACHE;
+            }
+            else if (loop_mode == "seek") {
+                param_.loop_mode_ = LOOP_SEEK;
+            }
+            else {
+                LOG(ERROR) << "[source]:" << "loop_mode " << loop_mode << " not supported";
+                return false;
+            }
+        }
+
+        if (paramSet.find("loop_cache_max_mb") != paramSet.end()) {
+            std::stringstream ss;
+            int max_mb = -1;
+            ss << paramSet["loop_cache_max_mb"];
+            ss >> max_mb;
+            if (max_mb <= 0) {
+                LOG(ERROR) << "[source]:" << "loop_cache_max_mb : invalid";
+                return false;
+            }
+            param_.loop_cache_max_bytes_ = static_cast<size_t>(max_mb) * 1024 * 1024;
+        }
+
+        if (paramSet.find("demux_queue_size") != paramSet.end()) {
+            std::stringstream ss;
+            int queue_size = -1;
+            ss << paramSet["demux_queue_size"];
+            ss >> queue_size;
+            if (queue_size < 0) {
+                LOG(ERROR) << "[source]:" << "demux_queue_size : invalid";
+                return false;
+            }
+            param_.demux_queue_size_ = static_cast<uint32_t>(queue_size);
+        }
+
+        if (paramSet.find("probesize") != paramSet.end()) {
+            std::stringstream ss;
+            int64_t probesize = -1;
+            ss << paramSet["probesize"];
+            ss >> probesize;
+            if (probesize < 0) {
+                LOG(ERROR) << "[source]:" << "probesize : invalid";
+                return false;
+            }
+            param_.probesize_ = probesize;
+        }
+
+        if (paramSet.find("analyzeduration") != paramSet.end()) {
+            std::stringstream ss;
+            int64_t duration = -1;
+            ss << paramSet["analyzeduration"];
+            ss >> duration;
+            if (duration < 0) {
+                LOG(ERROR) << "[source]:" << "analyzeduration : invalid";
+                return false;
+            }
+            param_.analyzeduration_ = duration;
+        }
+
+        if (paramSet.find("probe_cache") != paramSet.end()) {
+            param_.probe_cache_path_ = paramSet["probe_cache"];
+        }
+
+        if (paramSet.find("image_workers") != paramSet.end()) {
+            std::stringstream ss;
+            int workers = -1;
+            ss << paramSet["image_workers"];
+            ss >> workers;
+            if (workers < 0) {
+                LOG(ERROR) << "[source]:" << "image_workers : invalid";
+                return false;
+            }
+            param_.image_workers_ = static_cast<uint32_t>(workers);
+        }
+
+        if (paramSet.find("image_read_ahead") != paramSet.end()) {
+            std::stringstream ss;
+            int read_ahead = -1;
+            ss << paramSet["image_read_ahead"];
+            ss >> read_ahead;
+            if (read_ahead < 0) {
+                LOG(ERROR) << "[source]:" << "image_read_ahead : invalid";
+                return false;
+            }
+            param_.image_read_ahead_ = static_cast<uint32_t>(read_ahead);
+        }
+
+        if (paramSet.find("max_lag_ms") != paramSet.end()) {
+            std::stringstream ss;
+            int max_lag_ms = -1;
+            ss << paramSet["max_lag_ms"];
+            ss >> max_lag_ms;
+            if (max_lag_ms < 0) {
+                LOG(ERROR) << "[source]:" << "max_lag_ms : invalid";
+                return false;
+            }
+            param_.max_lag_ms_ = static_cast<uint32_t>(max_lag_ms);
+        }
+
+        if (paramSet.find("huge_pages") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "huge_pages", &param_.huge_pages_)) return false;
+        }
+
+        if (paramSet.find("prefault_frames") != paramSet.end()) {
+            if (!GetBoolParam(paramSet, "prefault_frames", &param_.prefault_frames_)) return false;
+        }
+
+        if ((param_.huge_pages_ || param_.prefault_frames_) && !param_.frame_allocator_) {
+            PooledCpuAllocator::Config config;
+            config.huge_pages = param_.huge_pages_;
+            config.prefault = param_.prefault_frames_;
+            // frames are allocated by decode threads and freed by pipeline threads, a thread cache would strand them
+            config.thread_cache_bytes = 0;
+            param_.frame_allocator_ = std::make_shared<PooledCpuAllocator>(config);
+        }
+
         if (paramSet.find("decoder_type") != paramSet.end()) {
             std::string dec_type = paramSet["decoder_type"];
             if (dec_type == "cpu") {
@@ -105,9 +312,111 @@ namespace easysa {
             ss << paramSet["output_buf_number"];
             ss >> param_.output_buf_number_;
         }
+
+        if (paramSet.find("decoder_threads") != paramSet.end()) {
+            std::string threads_str = paramSet["decoder_threads"];
+            if (threads_str == "auto") {
+                param_.decoder_threads_ = 0;
+            }
+            else {
+                std::stringstream ss;
+                int threads = -1;
+                ss << threads_str;
+                ss >> threads;
+                if (threads < 0) {
+                    LOG(ERROR) << "[source]:" << "decoder_threads : invalid";
+                    return false;
+                }
+                param_.decoder_threads_ = threads;
+            }
+        }
+
+        if (paramSet.find("thread_type") != paramSet.end()) {
+            std::string thread_type = paramSet["thread_type"];
+            if (thread_type == "frame") {
+                param_.thread_type_ = DECODER_THREAD_FRAME;
+            }
+            else if (thread_type == "slice") {
+                param_.thread_type_ = DECODER_THREAD_SLICE;
+            }
+            else if (thread_type == "auto") {
+                param_.thread_type_ = DECODER_THREAD_AUTO;
+            }
+            else {
+                LOG(ERROR) << "[source]:" << "thread_type " << thread_type << " not supported";
+                return false;
+            }
+        }
+
+        if (paramSet.find("max_decoder_threads") != paramSet.end()) {
+            std::stringstream ss;
+            int max_threads = -1;
+            ss << paramSet["max_decoder_threads"];
+            ss >> max_threads;
+            if (max_threads < 0) {
+                LOG(ERROR) << "[source]:" << "max_decoder_threads : invalid";
+                return false;
+            }
+            param_.max_decoder_threads_ = max_threads;
+            // the cap is shared by all decoders of the process
+            SetDecoderThreadLimit(max_threads);
+        }
+
+        if (paramSet.find("decode_workers") != paramSet.end()) {
+            std::stringstream ss;
+            int workers = -1;
+            ss << paramSet["decode_workers"];
+            ss >> workers;
+            if (workers < 0) {
+                LOG(ERROR) << "[source]:" << "decode_workers : invalid";
+                return false;
+            }
+            param_.decode_workers_ = workers;
+        }
+        if (param_.decode_workers_ == 0) {
+            param_.decode_workers_ = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        if (!scheduler_) {
+            scheduler_ = std::make_shared<DecodeScheduler>(param_.decode_workers_);
+            if (!scheduler_->Start()) {
+                scheduler_.reset();
+                return false;
+            }
+        }
         return true;
     }
 
-    bool DataSource::Close() { RemoveSources(); return true; }
+    std::shared_ptr<SharedDecodeStream> DataSource::GetSharedDecodeStream(const std::string& url, int framerate,
+        bool loop) {
+        std::lock_guard<std::mutex> lk(shared_streams_mutex_);
+        for (auto iter = shared_streams_.begin(); iter != shared_streams_.end();) {
+            if (iter->second.expired()) {
+                iter = shared_streams_.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+        std::shared_ptr<SharedDecodeStream> stream = shared_streams_[url].lock();
+        if (stream && !stream->IsFinished()) {
+            if (stream->GetFrameRate() != (framerate > 0 ? framerate : 0) || stream->GetLoop() != loop) {
+                LOG(WARNING) << "[source]:" << "shared decode keeps the frame rate and loop of the first stream -- "
+                    << url;
+            }
+            return stream;
+        }
+        stream = std::make_shared<SharedDecodeStream>(this, url, framerate, loop);
+        shared_streams_[url] = stream;
+        return stream;
+    }
+
+    bool DataSource::Close() {
+        RemoveSources();
+        if (scheduler_) {
+            scheduler_->Stop();
+            scheduler_.reset();
+        }
+        return true;
+    }
 
 }  // namespace easysa
\ No newline at end of file
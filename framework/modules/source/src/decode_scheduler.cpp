@@ -0,0 +1,122 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <glog/logging.h>
+
+#include "decode_scheduler.hpp"
+
+namespace easysa {
+
+    DecodeScheduler::~DecodeScheduler() {
+        Stop();
+    }
+
+    constexpr std::chrono::microseconds DecodeScheduler::kTick;
+
+    bool DecodeScheduler::Start() {
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (running_) return true;
+        if (worker_num_ == 0) {
+            LOG(ERROR) << "[source]:" << "decode scheduler needs at least one worker";
+            return false;
+        }
+        // the handler workers of the wheel are the decode workers
+        wheel_.reset(new (std::nothrow) TimerWheel(worker_num_, kTick));
+        if (!wheel_) {
+            LOG(ERROR) << "[source]:" << "decode scheduler start failed, no memory left";
+            return false;
+        }
+        running_ = true;
+        LOG(INFO) << "[source]:" << "decode scheduler started with " << worker_num_ << " workers";
+        return true;
+    }
+
+    void DecodeScheduler::Stop() {
+        std::unique_ptr<TimerWheel> wheel;
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            if (!running_) return;
+            running_ = false;
+            wheel = std::move(wheel_);
+        }
+        // joins the workers, a running step returns first, the handlers take mutex_
+        wheel.reset();
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (!entries_.empty()) {
+            LOG(WARNING) << "[source]:" << "decode scheduler stopped with " << entries_.size() << " streams left";
+        }
+        entries_.clear();
+        done_cond_.notify_all();
+    }
+
+    bool DecodeScheduler::Add(IScheduledStream* stream) {
+        if (!stream) return false;
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (!running_) {
+            LOG(ERROR) << "[source]:" << "decode scheduler is not running";
+            return false;
+        }
+        if (entries_.find(stream) != entries_.end()) {
+            LOG(ERROR) << "[source]:" << "stream already scheduled";
+            return false;
+        }
+        auto entry = std::make_shared<Entry>();
+        entry->stream = stream;
+        entries_[stream] = entry;
+        Arm(entry, std::chrono::steady_clock::now());
+        return true;
+    }
+
+    void DecodeScheduler::Remove(IScheduledStream* stream) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        auto iter = entries_.find(stream);
+        if (iter == entries_.end()) return;
+        std::shared_ptr<Entry> entry = iter->second;
+        entry->removed = true;
+        if (entry->armed && wheel_) {
+            // a timeout that already expired but did not start is dropped by the wheel
+            wheel_->remove(entry->timer);
+        }
+        done_cond_.wait(lk, [&]() { return !entry->running; });
+        entries_.erase(stream);
+    }
+
+    void DecodeScheduler::Arm(const std::shared_ptr<Entry>& entry, time_point deadline) {
+        entry->timer = wheel_->add(deadline, [this, entry](TimerWheel::timer_id) { Run(entry); });
+        entry->armed = true;
+    }
+
+    void DecodeScheduler::Run(const std::shared_ptr<Entry>& entry) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        // the wheel frees the id after this handler returns
+        entry->armed = false;
+        if (!running_ || entry->removed) return;
+        entry->running = true;
+        lk.unlock();
+
+        time_point next = std::chrono::steady_clock::now();
+        bool more = entry->stream->Step(&next);
+
+        lk.lock();
+        entry->running = false;
+        if (!more) {
+            entry->finished = true;
+        }
+        if (!running_ || entry->removed || entry->finished) {
+            done_cond_.notify_all();
+            return;
+        }
+        Arm(entry, next);
+    }
+
+}  // namespace easysa
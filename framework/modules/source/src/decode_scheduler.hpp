@@ -0,0 +1,93 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#ifndef MODULES_SOURCE_SRC_DECODE_SCHEDULER_HPP_
+#define MODULES_SOURCE_SRC_DECODE_SCHEDULER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "util/easysa_timer.hpp"
+
+namespace easysa {
+
+    /*
+    * @brief a stream driven by DecodeScheduler.
+    */
+    class IScheduledStream {
+    public:
+        virtual ~IScheduledStream() = default;
+        /*
+        * Runs one bounded piece of work (usually one packet) of the stream.
+        * @param next set to the time point at which the stream wants to run again,
+        *             it is now when the stream is not paced.
+        * @return false when the stream is finished and should not be scheduled again.
+        */
+        virtual bool Step(std::chrono::steady_clock::time_point* next) = 0;
+    };
+
+    /*
+    * @brief multiplexes many streams on a fixed pool of worker threads.
+    *
+    * The deadline of every stream is a timeout of one TimerWheel, whose handler workers run
+    * the steps, so no stream holds a thread while it waits for its next frame. Timeouts due in
+    * the same tick run in the order they expire, a stream that is never paced waits for the
+    * next tick and can not starve the streams already due. A stream has at most one timeout,
+    * so its steps never run concurrently and keep their order.
+    */
+    class DecodeScheduler {
+    public:
+        // deadlines are rounded up to the tick, which bounds how late a stream runs on an idle pool
+        static constexpr std::chrono::microseconds kTick{ 20 };
+
+        explicit DecodeScheduler(uint32_t worker_num) : worker_num_(worker_num) {}
+        ~DecodeScheduler();
+        bool Start();
+        void Stop();
+        bool Add(IScheduledStream* stream);
+        /*
+        * Stops scheduling the stream, waits for the running step (if any) to return.
+        * Must not be called from a Step() of the same stream.
+        */
+        void Remove(IScheduledStream* stream);
+        uint32_t GetWorkerNum() const { return worker_num_; }
+
+    private:
+        using time_point = std::chrono::steady_clock::time_point;
+        struct Entry {
+            IScheduledStream* stream = nullptr;
+            TimerWheel::timer_id timer = 0;
+            bool armed = false;  // the timeout is pending, its id is not given to another one yet
+            bool running = false;
+            bool removed = false;
+            bool finished = false;
+        };
+        // called with mutex_ held
+        void Arm(const std::shared_ptr<Entry>& entry, time_point deadline);
+        void Run(const std::shared_ptr<Entry>& entry);
+
+    private:
+        uint32_t worker_num_ = 0;
+        bool running_ = false;
+        std::mutex mutex_;
+        std::condition_variable done_cond_;
+        std::unordered_map<IScheduledStream*, std::shared_ptr<Entry>> entries_;
+        std::unique_ptr<TimerWheel> wheel_ = nullptr;
+
+    private:
+        DecodeScheduler(const DecodeScheduler&) = delete;
+        DecodeScheduler& operator=(const DecodeScheduler&) = delete;
+    };  // class DecodeScheduler
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_DECODE_SCHEDULER_HPP_
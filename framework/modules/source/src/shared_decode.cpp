@@ -0,0 +1,234 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "data_handler_file.hpp"
+#include "shared_decode.hpp"
+
+namespace easysa {
+
+    SharedDecodeStream::SharedDecodeStream(DataSource* module, const std::string& url, int framerate, bool loop)
+        : module_(module), url_(url), name_("shared:" + url), framerate_(framerate > 0 ? framerate : 0),
+        loop_(loop), parser_(name_), render_(nullptr), pacer_(framerate_) {
+        param_ = module_->GetParam();
+        // every frame is decoded, subscribers decimate by their own count
+        param_.interval_ = 1;
+    }
+
+    SharedDecodeStream::~SharedDecodeStream() {
+        running_.store(0);
+        if (scheduler_) {
+            scheduler_->Remove(this);
+            ClearResources();  // nothing left to clear if the stream finished by itself
+        }
+    }
+
+    bool SharedDecodeStream::Subscribe(ISharedFrameSink* sink) {
+        if (!sink) return false;
+        std::lock_guard<std::mutex> lk(sinks_mutex_);
+        if (finished_.load()) return false;
+        for (auto& ref : sinks_) {
+            if (ref->sink == sink) return false;
+        }
+        std::shared_ptr<SinkRef> ref = std::make_shared<SinkRef>();
+        ref->sink = sink;
+        sinks_.push_back(ref);
+        if (!running_.load()) {
+            running_.store(1);
+            scheduler_ = module_->GetDecodeScheduler();
+            if (!scheduler_ || !scheduler_->Add(this)) {
+                LOG(ERROR) << "[source]:" << "[" << name_ << "]: " << "Schedule stream failed";
+                scheduler_ = nullptr;
+                running_.store(0);
+                sinks_.pop_back();
+                return false;
+            }
+        }
+        LOG(INFO) << "[source]:" << "[" << name_ << "]: " << sinks_.size() << " subscribers";
+        return true;
+    }
+
+    void SharedDecodeStream::Unsubscribe(ISharedFrameSink* sink) {
+        std::shared_ptr<SinkRef> ref;
+        {
+            std::lock_guard<std::mutex> lk(sinks_mutex_);
+            auto iter = std::find_if(sinks_.begin(), sinks_.end(),
+                [sink](const std::shared_ptr<SinkRef>& r) { return r->sink == sink; });
+            if (iter == sinks_.end()) return;
+            ref = *iter;
+            sinks_.erase(iter);
+        }
+        // waits for a call in flight to this sink only
+        std::lock_guard<std::mutex> lk(ref->mutex);
+        ref->subscribed = false;
+    }
+
+    void SharedDecodeStream::Dispatch(const std::function<void(ISharedFrameSink*)>& call) {
+        // a sink blocked on backpressure must not stall the others, nor Subscribe and Unsubscribe
+        std::vector<std::shared_ptr<SinkRef>> sinks;
+        {
+            std::lock_guard<std::mutex> lk(sinks_mutex_);
+            sinks = sinks_;
+        }
+        for (auto& ref : sinks) {
+            std::lock_guard<std::mutex> lk(ref->mutex);
+            if (ref->subscribed) call(ref->sink);
+        }
+    }
+
+    void SharedDecodeStream::DispatchEos() {
+        {
+            std::lock_guard<std::mutex> lk(sinks_mutex_);
+            finished_.store(true);  // no subscriber joins after the eos
+        }
+        Dispatch([](ISharedFrameSink* sink) { sink->OnSharedEos(); });
+    }
+
+    void SharedDecodeStream::DispatchError(const std::string& message) {
+        Dispatch([&message](ISharedFrameSink* sink) { sink->OnSharedError(message); });
+    }
+
+    bool SharedDecodeStream::Step(std::chrono::steady_clock::time_point* next) {
+        if (!prepared_) {
+            prepared_ = true;
+            if (!PrepareResources()) {
+                ClearResources();
+                DispatchError("Prepare codec resources failed.");
+                DispatchEos();
+                LOG(ERROR) << "[source]:" << "[" << name_ << "]: "
+                    << "PrepareResources failed.";
+                return false;
+            }
+            if (framerate_ > 0) pacer_.Start();
+        }
+        if (!running_.load() || !Process()) {
+            LOG(INFO) << "[source]:" << "[" << name_ << "]: "
+                << "Shared decode stream exit.";
+            ClearResources();
+            if (!finished_.load()) DispatchEos();
+            return false;
+        }
+        if (framerate_ > 0) {
+            *next = pacer_.NextDeadline();
+        }
+        return true;
+    }
+
+    bool SharedDecodeStream::PrepareResources() {
+        FFParserParam parser_param;
+        parser_param.use_mmap = param_.use_mmap_;
+        parser_param.probesize = param_.probesize_;
+        parser_param.analyzeduration = param_.analyzeduration_;
+        parser_param.probe_cache = param_.probe_cache_path_;
+        int ret = parser_.Open(url_, this, parser_param);
+        return ret >= 0 && !dec_create_failed_;
+    }
+
+    void SharedDecodeStream::ClearResources() {
+        if (decoder_) {
+            decoder_->Destroy();
+            decoder_.reset();
+        }
+        parser_.Close();
+    }
+
+    bool SharedDecodeStream::Process() {
+        parser_.Parse();
+        if (eos_reached_) {
+            eos_reached_ = false;
+            if (loop_ && param_.loop_mode_ == LoopMode::LOOP_SEEK && parser_.Rewind() == 0) {
+                if (decoder_) decoder_->Flush();
+                return true;
+            }
+            if (loop_) {
+                parser_.Close();
+                if (!PrepareResources()) {
+                    DispatchError("Prepare codec resources failed");
+                    return false;
+                }
+                return true;
+            }
+            if (decoder_) decoder_->Process(nullptr);
+            return false;
+        }
+        if (decode_failed_ || dec_create_failed_) {
+            LOG(ERROR) << "[source]:" << "[" << name_ << "]: "
+                << "Decode failed";
+            return false;
+        }
+        return true;
+    }
+
+    // IParserResult methods
+    void SharedDecodeStream::OnParserInfo(VideoInfo* info) {
+        if (decoder_) {
+            return;  // reopened for loop, the decoder is kept
+        }
+        decoder_ = CreateDecoder(name_, this, info, param_);
+        if (!decoder_) {
+            dec_create_failed_ = true;
+            return;
+        }
+        if (info->extra_data.size()) {
+            VideoEsPacket pkt;
+            pkt.data = info->extra_data.data();
+            pkt.len = info->extra_data.size();
+            pkt.pts = 0;
+            if (!decoder_->Process(&pkt)) {
+                decode_failed_ = true;
+            }
+        }
+    }
+
+    void SharedDecodeStream::OnParserFrame(VideoEsFrame* frame) {
+        if (!frame) {
+            eos_reached_ = true;
+            return;
+        }
+        VideoEsPacket pkt;
+        pkt.data = frame->data;
+        pkt.len = frame->len;
+        pkt.pts = frame->pts;
+        if (frame->flags & VideoEsFrame::FLAG_KEY_FRAME) {
+            pkt.flags |= VideoEsPacket::FLAG_KEY_FRAME;
+        }
+        else if (param_.keyframe_only_) {
+            return;
+        }
+        decode_failed_ = !(decoder_ && decoder_->Process(&pkt));
+    }
+
+    // IDecodeResult methods
+    void SharedDecodeStream::OnDecodeError(DecodeErrorCode error_code) {
+        LOG(ERROR) << "[source]:" << "[" << name_ << "]: "
+            << "SharedDecodeStream::OnDecodeError() called";
+    }
+
+    void SharedDecodeStream::OnDecodeFrame(DecodeFrame* frame) {
+        if (!frame) return;
+        int64_t pts = frame->pts;
+        DataFramePtr dataframe;
+        if (frame->valid) {
+            dataframe = std::make_shared<DataFrame>();
+            if (render_.Process(dataframe, frame, frame_id_++, param_) < 0) {
+                return;
+            }
+        }
+        Dispatch([&dataframe, pts](ISharedFrameSink* sink) { sink->OnSharedFrame(dataframe, pts); });
+    }
+
+    void SharedDecodeStream::OnDecodeEos() {
+        DispatchEos();
+    }
+
+}  // namespace easysa
@@ -0,0 +1,116 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+
+#ifndef MODULES_SOURCE_SRC_SHARED_DECODE_HPP_
+#define MODULES_SOURCE_SRC_SHARED_DECODE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "data_handler_util.hpp"
+#include "data_source.hpp"
+#include "decode_scheduler.hpp"
+#include "util/easysa_frame_pacer.hpp"
+#include "util/video_decoder.hpp"
+#include "util/video_parser.hpp"
+
+namespace easysa {
+
+    /*
+    * @brief receiver of the frames of a SharedDecodeStream, one per subscribed stream.
+    *
+    * Callbacks run on the decode scheduler worker that steps the shared stream.
+    */
+    class ISharedFrameSink {
+    public:
+        virtual ~ISharedFrameSink() = default;
+        /*
+        * the frame is shared by all subscribers and must be treated as read-only,
+        * nullptr for a frame the decoder marked invalid
+        */
+        virtual void OnSharedFrame(const DataFramePtr& frame, int64_t pts) = 0;
+        virtual void OnSharedEos() = 0;
+        virtual void OnSharedError(const std::string& message) = 0;
+    };
+
+    /*
+    * @brief decodes one url once and fans the frames out to every subscribed stream.
+    *
+    * Created by DataSource::GetSharedDecodeStream(), alive as long as a stream holds it.
+    * Decoding starts with the first subscriber and stops when the last reference is released.
+    * The stream runs on the decode scheduler of the module like the file streams.
+    */
+    class SharedDecodeStream : public IParserResult, public IDecodeResult, public IScheduledStream {
+    public:
+        SharedDecodeStream(DataSource* module, const std::string& url, int framerate, bool loop);
+        ~SharedDecodeStream();
+        bool Subscribe(ISharedFrameSink* sink);
+        void Unsubscribe(ISharedFrameSink* sink);
+        bool IsFinished() const { return finished_.load(); }
+        int GetFrameRate() const { return framerate_; }
+        bool GetLoop() const { return loop_; }
+
+    private:
+        bool PrepareResources();
+        void ClearResources();
+        bool Process();
+        void Dispatch(const std::function<void(ISharedFrameSink*)>& call);
+        void DispatchEos();
+        void DispatchError(const std::string& message);
+
+        // IScheduledStream methods
+        bool Step(std::chrono::steady_clock::time_point* next) override;
+
+        // IParserResult methods
+        void OnParserInfo(VideoInfo* info) override;
+        void OnParserFrame(VideoEsFrame* frame) override;
+
+        // IDecodeResult methods
+        void OnDecodeError(DecodeErrorCode error_code) override;
+        void OnDecodeFrame(DecodeFrame* frame) override;
+        void OnDecodeEos() override;
+
+    private:
+        DataSource* module_ = nullptr;
+        std::string url_;
+        std::string name_;  // used as stream id in logs
+        int framerate_;
+        bool loop_ = false;
+        DataSourceParam param_;
+
+        FFParser parser_;
+        std::shared_ptr<Decoder> decoder_ = nullptr;
+        SourceRender render_;  // converts decoded frames, not bound to a stream
+        bool dec_create_failed_ = false;
+        bool decode_failed_ = false;
+        bool eos_reached_ = false;
+        uint64_t frame_id_ = 0;
+
+        struct SinkRef {
+            ISharedFrameSink* sink;
+            std::mutex mutex;  // held while the sink is called, so an unsubscribed sink is never called
+            bool subscribed = true;
+        };
+        std::mutex sinks_mutex_;  // guards the list only, sinks are called without it
+        std::vector<std::shared_ptr<SinkRef>> sinks_;
+        std::atomic<int> running_{ 0 };
+        std::atomic<bool> finished_{ false };
+        DecodeScheduler* scheduler_ = nullptr;  // set once the first subscriber starts the stream
+        bool prepared_ = false;
+        FramePacer pacer_;
+    };  // class SharedDecodeStream
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_SHARED_DECODE_HPP_
@@ -0,0 +1,127 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#include <stdlib.h>
+#if defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <glog/logging.h>
+
+#include "frame_buffer_pool.hpp"
+
+namespace easysa {
+
+    static constexpr size_t kPageSize = 4096;
+
+    static void* PageAlignedAlloc(size_t size) {
+#if defined(_WIN32) || defined(_WIN64)
+        return _aligned_malloc(size, kPageSize);
+#else
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, kPageSize, size) != 0) return nullptr;
+        return ptr;
+#endif
+    }
+
+    static void PageAlignedFree(void* ptr) {
+#if defined(_WIN32) || defined(_WIN64)
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    std::shared_ptr<FrameBufferPool> FrameBufferPool::Create(uint32_t capacity,
+        std::shared_ptr<MemoryAllocator> allocator) {
+        std::shared_ptr<FrameBufferPool> pool(new (std::nothrow) FrameBufferPool(std::max(capacity, 1u), allocator));
+        return pool;
+    }
+
+    void* FrameBufferPool::AllocBuffer(size_t size) {
+        return allocator_ ? allocator_->alloc(size) : PageAlignedAlloc(size);
+    }
+
+    void FrameBufferPool::FreeBuffer(void* ptr) {
+        if (allocator_) {
+            allocator_->free(ptr);
+        }
+        else {
+            PageAlignedFree(ptr);
+        }
+    }
+
+    FrameBufferPool::~FrameBufferPool() {
+        ClearFreeList();
+    }
+
+    void FrameBufferPool::ClearFreeList() {
+        for (auto ptr : free_list_) {
+            FreeBuffer(ptr);
+        }
+        free_list_.clear();
+    }
+
+    std::shared_ptr<void> FrameBufferPool::GetBuffer(size_t size) {
+        size = (size + kPageSize - 1) / kPageSize * kPageSize;
+        void* ptr = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (size != buffer_size_) {
+                // resolution changed, buffers of the old size are freed when they come back
+                ClearFreeList();
+                buffer_size_ = size;
+                stats_.buffer_size = size;
+            }
+            if (!free_list_.empty()) {
+                ptr = free_list_.back();
+                free_list_.pop_back();
+                stats_.reused++;
+            }
+            else {
+                stats_.allocated++;
+            }
+            stats_.in_use++;
+            stats_.high_water_mark = std::max(stats_.high_water_mark, stats_.in_use);
+        }
+        if (!ptr) {
+            ptr = AllocBuffer(size);
+            if (!ptr) {
+                std::lock_guard<std::mutex> lk(mutex_);
+                stats_.allocated--;
+                stats_.in_use--;
+                return nullptr;
+            }
+        }
+        std::shared_ptr<FrameBufferPool> self = shared_from_this();
+        return std::shared_ptr<void>(ptr, [self, size](void* p) { self->Release(p, size); });
+    }
+
+    void FrameBufferPool::Release(void* ptr, size_t size) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        stats_.in_use--;
+        if (size == buffer_size_ && free_list_.size() < capacity_) {
+            free_list_.push_back(ptr);
+            return;
+        }
+        lk.unlock();
+        FreeBuffer(ptr);
+    }
+
+    FrameBufferPoolStats FrameBufferPool::GetStats() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        FrameBufferPoolStats stats = stats_;
+        stats.capacity = capacity_;
+        return stats;
+    }
+
+}  // namespace easysa
@@ -0,0 +1,71 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#ifndef MODULES_SOURCE_SRC_UTIL_FRAME_BUFFER_POOL_HPP_
+#define MODULES_SOURCE_SRC_UTIL_FRAME_BUFFER_POOL_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "easysa_allocator.hpp"
+
+namespace easysa {
+
+    struct FrameBufferPoolStats {
+        size_t buffer_size = 0;        // bytes of one buffer, page aligned
+        uint32_t capacity = 0;         // max buffers kept for reuse
+        uint32_t in_use = 0;           // buffers held by frames right now
+        uint32_t high_water_mark = 0;  // max buffers held by frames at the same time
+        uint64_t allocated = 0;        // buffers allocated from system
+        uint64_t reused = 0;           // buffers served from the free list
+    };
+
+    /*
+    * @brief per-stream pool of page aligned decoder output buffers.
+    *
+    * Buffers are handed out as shared_ptr and go back to the pool through the deleter,
+    * so they can be held by frames after the stream is closed. All buffers of a pool
+    * have the same size; when the resolution changes the free list is dropped and
+    * buffers of the old size are freed when they come back.
+    * Buffers are page aligned, or come from allocator when one is given, e.g. a
+    * PooledCpuAllocator with huge pages.
+    */
+    class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+    public:
+        static std::shared_ptr<FrameBufferPool> Create(uint32_t capacity,
+            std::shared_ptr<MemoryAllocator> allocator = nullptr);
+        ~FrameBufferPool();
+        std::shared_ptr<void> GetBuffer(size_t size);
+        FrameBufferPoolStats GetStats();
+
+    private:
+        FrameBufferPool(uint32_t capacity, std::shared_ptr<MemoryAllocator> allocator)
+            : capacity_(capacity), allocator_(allocator) {}
+        void Release(void* ptr, size_t size);
+        void ClearFreeList();
+        void* AllocBuffer(size_t size);
+        void FreeBuffer(void* ptr);
+
+    private:
+        std::mutex mutex_;
+        uint32_t capacity_ = 0;
+        std::shared_ptr<MemoryAllocator> allocator_;
+        size_t buffer_size_ = 0;
+        std::vector<void*> free_list_;
+        FrameBufferPoolStats stats_;
+
+    private:
+        FrameBufferPool(const FrameBufferPool&) = delete;
+        FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+    };  // class FrameBufferPool
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_UTIL_FRAME_BUFFER_POOL_HPP_
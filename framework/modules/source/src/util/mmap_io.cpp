@@ -0,0 +1,203 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#if defined(__linux) || defined(__unix)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <glog/logging.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include "mmap_io.hpp"
+
+namespace easysa {
+
+    static constexpr int kIOBufferSize = 64 * 1024;
+
+    static std::mutex mapped_files_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<MappedFile>> mapped_files;
+
+#if defined(__linux) || defined(__unix)
+    // path, inode, size and mtime, a file replaced or rewritten at the same path gets a new key
+    static std::string MakeMapKey(const std::string& path, const struct stat& st) {
+        std::stringstream ss;
+        ss << path << "|" << static_cast<uint64_t>(st.st_ino) << "|" << static_cast<int64_t>(st.st_size)
+            << "|" << static_cast<int64_t>(st.st_mtime);
+        return ss.str();
+    }
+#elif defined(_WIN32) || defined(_WIN64)
+    static std::string MakeMapKey(const std::string& path, const WIN32_FILE_ATTRIBUTE_DATA& attr) {
+        std::stringstream ss;
+        ss << path << "|" << attr.nFileSizeHigh << "|" << attr.nFileSizeLow
+            << "|" << attr.ftLastWriteTime.dwHighDateTime << "|" << attr.ftLastWriteTime.dwLowDateTime;
+        return ss.str();
+    }
+#endif
+
+    std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+        std::string key = path;
+#if defined(__linux) || defined(__unix)
+        struct stat path_st;
+        if (stat(path.c_str(), &path_st) != 0) return nullptr;
+        key = MakeMapKey(path, path_st);
+#elif defined(_WIN32) || defined(_WIN64)
+        WIN32_FILE_ATTRIBUTE_DATA attr;
+        if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attr)) return nullptr;
+        key = MakeMapKey(path, attr);
+#endif
+        std::lock_guard<std::mutex> lk(mapped_files_mutex);
+        for (auto iter = mapped_files.begin(); iter != mapped_files.end();) {
+            // mappings of replaced files are dropped with their last stream
+            if (iter->second.expired()) {
+                iter = mapped_files.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+        auto iter = mapped_files.find(key);
+        if (iter != mapped_files.end()) {
+            std::shared_ptr<MappedFile> file = iter->second.lock();
+            if (file) return file;
+        }
+
+        std::shared_ptr<MappedFile> file(new (std::nothrow) MappedFile());
+        if (!file) return nullptr;
+        file->path_ = path;
+#if defined(__linux) || defined(__unix)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);  // the mapping keeps the file referenced
+        key = MakeMapKey(path, st);  // the file opened, in case it was replaced since stat
+        if (addr == MAP_FAILED) {
+            LOG(WARNING) << "[source]:" << "mmap failed -- " << path;
+            return nullptr;
+        }
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        file->data_ = static_cast<const uint8_t*>(addr);
+        file->size_ = st.st_size;
+#elif defined(_WIN32) || defined(_WIN64)
+        HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file_handle == INVALID_HANDLE_VALUE) return nullptr;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+            CloseHandle(file_handle);
+            return nullptr;
+        }
+        HANDLE mapping = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file_handle);
+        if (!mapping) return nullptr;
+        void* addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!addr) {
+            CloseHandle(mapping);
+            LOG(WARNING) << "[source]:" << "MapViewOfFile failed -- " << path;
+            return nullptr;
+        }
+        file->mapping_handle_ = mapping;
+        file->data_ = static_cast<const uint8_t*>(addr);
+        file->size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+        return nullptr;
+#endif
+        mapped_files[key] = file;
+        return file;
+    }
+
+    MappedFile::~MappedFile() {
+        if (!data_) return;
+#if defined(__linux) || defined(__unix)
+        munmap(const_cast<uint8_t*>(data_), size_);
+#elif defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(data_);
+        CloseHandle(mapping_handle_);
+#endif
+        data_ = nullptr;
+    }
+
+    MmapIOContext::~MmapIOContext() {
+        if (avio_) {
+            av_freep(&avio_->buffer);
+            av_freep(&avio_);
+        }
+    }
+
+    bool MmapIOContext::Init() {
+        if (!file_) return false;
+        uint8_t* buffer = static_cast<uint8_t*>(av_malloc(kIOBufferSize));
+        if (!buffer) return false;
+        avio_ = avio_alloc_context(buffer, kIOBufferSize, 0, this, &MmapIOContext::Read, nullptr,
+            &MmapIOContext::Seek);
+        if (!avio_) {
+            av_free(buffer);
+            return false;
+        }
+        return true;
+    }
+
+    int MmapIOContext::Read(void* opaque, uint8_t* buf, int buf_size) {
+        MmapIOContext* ctx = reinterpret_cast<MmapIOContext*>(opaque);
+        size_t left = ctx->file_->size() - ctx->pos_;
+        if (left == 0) return AVERROR_EOF;
+        size_t bytes = std::min(left, static_cast<size_t>(buf_size));
+        memcpy(buf, ctx->file_->data() + ctx->pos_, bytes);
+        ctx->pos_ += bytes;
+        return static_cast<int>(bytes);
+    }
+
+    int64_t MmapIOContext::Seek(void* opaque, int64_t offset, int whence) {
+        MmapIOContext* ctx = reinterpret_cast<MmapIOContext*>(opaque);
+        int64_t size = static_cast<int64_t>(ctx->file_->size());
+        int64_t pos = 0;
+        switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = static_cast<int64_t>(ctx->pos_) + offset;
+            break;
+        case SEEK_END:
+            pos = size + offset;
+            break;
+        default:
+            return -1;
+        }
+        if (pos < 0 || pos > size) return -1;
+        ctx->pos_ = static_cast<size_t>(pos);
+        return pos;
+    }
+
+}  // namespace easysa
@@ -0,0 +1,82 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#ifndef MODULES_SOURCE_SRC_UTIL_MMAP_IO_HPP_
+#define MODULES_SOURCE_SRC_UTIL_MMAP_IO_HPP_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavformat/avio.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace easysa {
+
+    /*
+    * @brief read-only mapping of a whole file.
+    *
+    * Mappings are shared by path, size and modification time, all streams reading the same file use one
+    * mapping. A file replaced at the same path is mapped anew.
+    */
+    class MappedFile {
+    public:
+        /*
+        * @return the mapping of the file, nullptr if the file can not be mapped
+        */
+        static std::shared_ptr<MappedFile> Open(const std::string& path);
+        ~MappedFile();
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+    private:
+        std::string path_;
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+#if defined(_WIN32) || defined(_WIN64)
+        void* mapping_handle_ = nullptr;
+#endif
+    };  // class MappedFile
+
+    /*
+    * @brief AVIOContext reading from a MappedFile, one per stream.
+    */
+    class MmapIOContext {
+    public:
+        explicit MmapIOContext(std::shared_ptr<MappedFile> file) : file_(file) {}
+        ~MmapIOContext();
+        bool Init();
+        AVIOContext* GetIOContext() const { return avio_; }
+
+    private:
+        static int Read(void* opaque, uint8_t* buf, int buf_size);
+        static int64_t Seek(void* opaque, int64_t offset, int whence);
+
+    private:
+        std::shared_ptr<MappedFile> file_;
+        size_t pos_ = 0;
+        AVIOContext* avio_ = nullptr;
+
+    private:
+        MmapIOContext(const MmapIOContext&) = delete;
+        MmapIOContext& operator=(const MmapIOContext&) = delete;
+    };  // class MmapIOContext
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_UTIL_MMAP_IO_HPP_
@@ -0,0 +1,170 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <glog/logging.h>
+
+#include "packet_cache.hpp"
+
+namespace easysa {
+
+#ifndef AV_INPUT_BUFFER_PADDING_SIZE
+#define AV_INPUT_BUFFER_PADDING_SIZE FF_INPUT_BUFFER_PADDING_SIZE
+#endif
+
+    class EsPacketCache::Builder : public IParserResult {
+    public:
+        Builder(EsPacketCache* cache, size_t max_bytes) : cache_(cache), max_bytes_(max_bytes) {}
+        void OnParserInfo(VideoInfo* info) override {
+            cache_->info_ = *info;
+            got_info_ = true;
+        }
+        void OnParserFrame(VideoEsFrame* frame) override {
+            if (!frame) {
+                eos_ = true;
+                return;
+            }
+            if (overflow_) return;
+            size_t offset = cache_->data_.size();
+            size_t bytes = frame->len + AV_INPUT_BUFFER_PADDING_SIZE;
+            if (offset + bytes > max_bytes_) {
+                overflow_ = true;
+                return;
+            }
+            cache_->data_.resize(offset + bytes, 0);
+            memcpy(cache_->data_.data() + offset, frame->data, frame->len);
+            cache_->packets_.push_back(Packet{ offset, frame->len, frame->pts, frame->flags });
+        }
+        bool got_info_ = false;
+        bool eos_ = false;
+        bool overflow_ = false;
+
+    private:
+        EsPacketCache* cache_;
+        size_t max_bytes_;
+    };
+
+    struct CacheSlot {
+        std::mutex mutex;  // held while the cache is built, so a file is demuxed once
+        std::weak_ptr<EsPacketCache> cache;
+        // the file could not be cached with limits up to this, later streams fall back at once
+        size_t failed_max_bytes = 0;
+    };
+    static std::mutex cache_slots_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<CacheSlot>> cache_slots;
+
+    // path, size and mtime of a local file, a replaced or rewritten file gets a new key
+    static std::string MakeSlotKey(const std::string& url, size_t* file_bytes) {
+        *file_bytes = 0;
+        if (url.find("://") != std::string::npos) return url;
+        std::string path = url.compare(0, 5, "file:") == 0 ? url.substr(5) : url;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return url;
+        *file_bytes = static_cast<size_t>(st.st_size);
+        std::stringstream ss;
+        ss << path << "|" << static_cast<int64_t>(st.st_size) << "|" << static_cast<int64_t>(st.st_mtime);
+        return ss.str();
+    }
+
+    // drops slots of released caches; called with cache_slots_mutex held
+    static void SweepCacheSlots() {
+        for (auto iter = cache_slots.begin(); iter != cache_slots.end();) {
+            std::shared_ptr<CacheSlot>& slot = iter->second;
+            // a slot only the map holds is not used by any Get(), try_lock skips one being built anyway
+            bool unused = false;
+            if (slot.use_count() == 1 && slot->mutex.try_lock()) {
+                unused = slot->failed_max_bytes == 0 && slot->cache.expired();
+                slot->mutex.unlock();
+            }
+            if (unused) {
+                iter = cache_slots.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+
+    std::shared_ptr<EsPacketCache> EsPacketCache::Get(const std::string& url, const std::string& stream_id,
+        size_t max_bytes, const FFParserParam& param) {
+        size_t file_bytes = 0;
+        std::string key = MakeSlotKey(url, &file_bytes);
+        std::shared_ptr<CacheSlot> slot;
+        {
+            std::lock_guard<std::mutex> lk(cache_slots_mutex);
+            SweepCacheSlots();
+            std::shared_ptr<CacheSlot>& entry = cache_slots[key];
+            if (!entry) entry = std::make_shared<CacheSlot>();
+            slot = entry;
+        }
+        std::lock_guard<std::mutex> slot_lk(slot->mutex);
+        std::shared_ptr<EsPacketCache> cache = slot->cache.lock();
+        if (cache) return cache;
+        if (max_bytes <= slot->failed_max_bytes) return nullptr;
+
+        cache.reset(new (std::nothrow) EsPacketCache());
+        if (!cache) return nullptr;
+        // packets take about the file size, reserving it saves regrowing and shrinking the buffer
+        if (file_bytes) cache->data_.reserve(std::min(max_bytes, file_bytes + file_bytes / 16));
+        Builder builder(cache.get(), max_bytes);
+        FFParser parser(stream_id);
+        if (parser.Open(url, &builder, param) < 0 || !builder.got_info_) {
+            parser.Close();
+            // only a local file is known not to change between attempts
+            if (file_bytes) slot->failed_max_bytes = SIZE_MAX;
+            return nullptr;
+        }
+        while (!builder.eos_ && !builder.overflow_) {
+            if (parser.Parse() < 0 && !builder.eos_) break;
+        }
+        parser.Close();
+        if (builder.overflow_ || cache->packets_.empty()) {
+            LOG(WARNING) << "[source]: " << "[" << stream_id << "]: "
+                << "packets not cached, file is empty or larger than " << max_bytes << " bytes -- " << url;
+            if (file_bytes) slot->failed_max_bytes = builder.overflow_ ? max_bytes : SIZE_MAX;
+            return nullptr;
+        }
+
+        // one pass lasts from the first pts to one frame after the last one
+        int64_t min_pts = cache->packets_.front().pts;
+        int64_t max_pts = min_pts;
+        for (auto& pkt : cache->packets_) {
+            min_pts = std::min(min_pts, pkt.pts);
+            max_pts = std::max(max_pts, pkt.pts);
+        }
+        int64_t frame_duration = 1;
+        if (cache->packets_.size() > 1) {
+            frame_duration = std::max<int64_t>((max_pts - min_pts) / static_cast<int64_t>(cache->packets_.size() - 1), 1);
+        }
+        cache->duration_ = max_pts - min_pts + frame_duration;
+
+        LOG(INFO) << "[source]: " << "[" << stream_id << "]: "
+            << "cached " << cache->packets_.size() << " packets, " << cache->data_.size() << " bytes -- " << url;
+        slot->cache = cache;
+        return cache;
+    }
+
+    void EsPacketCache::GetFrame(size_t index, VideoEsFrame* frame) const {
+        const Packet& pkt = packets_[index];
+        frame->data = const_cast<uint8_t*>(data_.data() + pkt.offset);
+        frame->len = pkt.len;
+        frame->pts = pkt.pts;
+        frame->flags = pkt.flags;
+    }
+
+}  // namespace easysa
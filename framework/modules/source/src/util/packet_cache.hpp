@@ -0,0 +1,71 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#ifndef MODULES_SOURCE_SRC_UTIL_PACKET_CACHE_HPP_
+#define MODULES_SOURCE_SRC_UTIL_PACKET_CACHE_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "video_parser.hpp"
+
+namespace easysa {
+
+    /*
+    * @brief read-only cache of all Annex-B packets of a file, demuxed once.
+    *
+    * Caches are shared by url, so many streams looping the same file replay one copy.
+    * Every packet is followed by zeroed padding as the decoder requires.
+    */
+    class EsPacketCache {
+    public:
+        /*
+        * Gets the cache of the url, demuxes the file if nobody holds it yet.
+        *
+        * @param max_bytes the file is not cached if its packets take more than this.
+        * @return the cache, nullptr if the file can not be demuxed or is too large.
+        */
+        static std::shared_ptr<EsPacketCache> Get(const std::string& url, const std::string& stream_id,
+            size_t max_bytes, const FFParserParam& param = FFParserParam());
+
+        const VideoInfo& GetVideoInfo() const { return info_; }
+        size_t Size() const { return packets_.size(); }
+        size_t Bytes() const { return data_.size(); }
+        /*
+        * pts span of one pass over the file, the pts of the n-th replay is rebased by n * duration
+        */
+        int64_t GetDuration() const { return duration_; }
+        /*
+        * fills the frame with the packet, data points into the cache
+        */
+        void GetFrame(size_t index, VideoEsFrame* frame) const;
+
+    private:
+        struct Packet {
+            size_t offset;
+            size_t len;
+            int64_t pts;
+            uint32_t flags;
+        };
+        class Builder;
+        EsPacketCache() = default;
+        EsPacketCache(const EsPacketCache&) = delete;
+        EsPacketCache& operator=(const EsPacketCache&) = delete;
+
+    private:
+        VideoInfo info_;
+        std::vector<uint8_t> data_;
+        std::vector<Packet> packets_;
+        int64_t duration_ = 0;
+    };  // class EsPacketCache
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_UTIL_PACKET_CACHE_HPP_
@@ -0,0 +1,144 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <glog/logging.h>
+
+#include "probe_cache.hpp"
+
+namespace easysa {
+
+    static std::mutex probe_caches_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<ProbeCache>> probe_caches;
+
+    static std::string ToHex(const std::vector<uint8_t>& data) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(data.size() * 2);
+        for (uint8_t byte : data) {
+            hex.push_back(digits[byte >> 4]);
+            hex.push_back(digits[byte & 0x0f]);
+        }
+        return hex;
+    }
+
+    static bool FromHex(const std::string& hex, std::vector<uint8_t>* data) {
+        if (hex.size() % 2) return false;
+        data->resize(hex.size() / 2);
+        for (size_t i = 0; i < data->size(); ++i) {
+            unsigned int byte = 0;
+            if (sscanf(hex.c_str() + i * 2, "%2x", &byte) != 1) return false;
+            (*data)[i] = static_cast<uint8_t>(byte);
+        }
+        return true;
+    }
+
+    std::shared_ptr<ProbeCache> ProbeCache::Get(const std::string& path) {
+        if (path.empty()) return nullptr;
+        std::lock_guard<std::mutex> lk(probe_caches_mutex);
+        std::shared_ptr<ProbeCache> cache = probe_caches[path].lock();
+        if (cache) return cache;
+        cache.reset(new (std::nothrow) ProbeCache(path));
+        if (!cache) return nullptr;
+        cache->Load();
+        probe_caches[path] = cache;
+        return cache;
+    }
+
+    std::string ProbeCache::MakeKey(const std::string& url) {
+        if (url.find("://") != std::string::npos) return url;
+        std::string path = url.compare(0, 5, "file:") == 0 ? url.substr(5) : url;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return "";
+        // a replaced or rewritten file gets a new key
+        std::stringstream ss;
+        ss << path << "|" << static_cast<int64_t>(st.st_size) << "|" << static_cast<int64_t>(st.st_mtime);
+        return ss.str();
+    }
+
+    bool ProbeCache::Lookup(const std::string& key, ProbeInfo* info) const {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto iter = entries_.find(key);
+        if (iter == entries_.end()) return false;
+        *info = iter->second;
+        return true;
+    }
+
+    void ProbeCache::Store(const std::string& key, const ProbeInfo& info) {
+        if (key.empty() || key.find_first_of("\t\n") != std::string::npos) return;
+        std::lock_guard<std::mutex> lk(mutex_);
+        entries_[key] = info;
+        if (!Save()) {
+            LOG(WARNING) << "[source]:" << "failed to write probe cache -- " << path_;
+        }
+    }
+
+    /*
+    * one entry per line, tab separated:
+    * key stream_index codec_id width height field_order frame_rate_num frame_rate_den extra_data(hex, - if none)
+    */
+    void ProbeCache::Load() {
+        std::ifstream file(path_);
+        if (!file.is_open()) return;
+        std::string line;
+        size_t bad = 0;
+        while (std::getline(file, line)) {
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos) {
+                bad++;
+                continue;
+            }
+            std::string key = line.substr(0, tab);
+            std::stringstream ss(line.substr(tab + 1));
+            ProbeInfo info;
+            std::string hex;
+            ss >> info.stream_index >> info.codec_id >> info.width >> info.height >> info.field_order
+                >> info.frame_rate_num >> info.frame_rate_den >> hex;
+            if (ss.fail() || (hex != "-" && !FromHex(hex, &info.extra_data))) {
+                bad++;
+                continue;
+            }
+            entries_[key] = info;
+        }
+        if (bad) {
+            LOG(WARNING) << "[source]:" << "ignored " << bad << " bad entries of probe cache -- " << path_;
+        }
+        LOG(INFO) << "[source]:" << "loaded " << entries_.size() << " entries of probe cache -- " << path_;
+    }
+
+    bool ProbeCache::Save() const {
+        // written aside and renamed, so a crash never leaves a truncated cache
+        std::string tmp_path = path_ + ".tmp";
+        {
+            std::ofstream file(tmp_path, std::ios::trunc);
+            if (!file.is_open()) return false;
+            for (auto& entry : entries_) {
+                const ProbeInfo& info = entry.second;
+                file << entry.first << '\t' << info.stream_index << ' ' << info.codec_id << ' '
+                    << info.width << ' ' << info.height << ' ' << info.field_order << ' '
+                    << info.frame_rate_num << ' ' << info.frame_rate_den << ' '
+                    << (info.extra_data.empty() ? "-" : ToHex(info.extra_data)) << '\n';
+            }
+            if (!file.good()) return false;
+        }
+#if defined(_WIN32) || defined(_WIN64)
+        std::remove(path_.c_str());
+#endif
+        return std::rename(tmp_path.c_str(), path_.c_str()) == 0;
+    }
+
+}  // namespace easysa
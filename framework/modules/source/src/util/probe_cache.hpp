@@ -0,0 +1,70 @@
+/*************************************************************************
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *************************************************************************/
+#ifndef MODULES_SOURCE_SRC_UTIL_PROBE_CACHE_HPP_
+#define MODULES_SOURCE_SRC_UTIL_PROBE_CACHE_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace easysa {
+
+    /*
+    * @brief stream parameters found by avformat_find_stream_info
+    */
+    struct ProbeInfo {
+        int stream_index = -1;
+        int codec_id = 0;  // AVCodecID
+        int width = 0;
+        int height = 0;
+        int field_order = 0;  // AVFieldOrder
+        int frame_rate_num = 0;
+        int frame_rate_den = 0;
+        std::vector<uint8_t> extra_data;
+    };
+
+    /*
+    * @brief probe results persisted in a file, so known sources are opened without probing.
+    *
+    * Local files are keyed by path, size and modification time, other urls by the url.
+    * Caches are shared by file path, every entry stored is written back at once.
+    */
+    class ProbeCache {
+    public:
+        /*
+        * @return the cache stored in path, created empty if the file does not exist yet
+        */
+        static std::shared_ptr<ProbeCache> Get(const std::string& path);
+        /*
+        * @return the key of the url, empty if a local file can not be stat'ed
+        */
+        static std::string MakeKey(const std::string& url);
+
+        bool Lookup(const std::string& key, ProbeInfo* info) const;
+        void Store(const std::string& key, const ProbeInfo& info);
+
+    private:
+        explicit ProbeCache(const std::string& path) : path_(path) {}
+        ProbeCache(const ProbeCache&) = delete;
+        ProbeCache& operator=(const ProbeCache&) = delete;
+        void Load();
+        bool Save() const;
+
+    private:
+        std::string path_;
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, ProbeInfo> entries_;
+    };  // class ProbeCache
+
+}  // namespace easysa
+
+#endif  // MODULES_SOURCE_SRC_UTIL_PROBE_CACHE_HPP_
@@ -7,6 +7,7 @@
  *
  *************************************************************************/
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <memory>
@@ -33,6 +34,75 @@ namespace easysa {
     // since from version 3.1(libavformat/version:57.40.100)
 #define FFMPEG_VERSION_3_1 AV_VERSION_INT(57, 40, 100)
 
+    // FFMPEG use avcodec_send_packet/avcodec_receive_frame instead of avcodec_decode_video2
+    // since from version 3.1(libavcodec/version:57.48.101)
+#define FFMPEG_VERSION_SEND_RECEIVE AV_VERSION_INT(57, 48, 101)
+
+    //----------------------------------------------------------------------------
+    // decoder threads budget, shared by all decoders of the process
+    static std::mutex thread_budget_mutex;
+    static int thread_budget_limit = 0;
+    static int thread_budget_used = 0;
+
+    void SetDecoderThreadLimit(int limit) {
+        std::lock_guard<std::mutex> lk(thread_budget_mutex);
+        thread_budget_limit = limit > 0 ? limit : 0;
+    }
+
+    int GetDecoderThreadLimit() {
+        std::lock_guard<std::mutex> lk(thread_budget_mutex);
+        return thread_budget_limit;
+    }
+
+    int GetDecoderThreadsInUse() {
+        std::lock_guard<std::mutex> lk(thread_budget_mutex);
+        return thread_budget_used;
+    }
+
+    static int AcquireDecoderThreads(int wanted) {
+        std::lock_guard<std::mutex> lk(thread_budget_mutex);
+        int granted = wanted;
+        if (thread_budget_limit > 0) {
+            granted = std::min(wanted, thread_budget_limit - thread_budget_used);
+        }
+        granted = std::max(granted, 1);
+        thread_budget_used += granted;
+        return granted;
+    }
+
+    static void ReleaseDecoderThreads(int threads) {
+        std::lock_guard<std::mutex> lk(thread_budget_mutex);
+        thread_budget_used -= threads;
+        if (thread_budget_used < 0) thread_budget_used = 0;
+    }
+
+    /*
+    * one thread for every 720p worth of pixels, e.g. 1080p gets 3 threads and 4K gets 9,
+    * never more than the hardware threads.
+    */
+    static int AutoDecoderThreads(int width, int height) {
+        if (width <= 0 || height <= 0) return 1;
+        const int64_t pixels_per_thread = 1280 * 720;
+        int64_t threads = (static_cast<int64_t>(width) * height + pixels_per_thread - 1) / pixels_per_thread;
+        int hw_threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (hw_threads > 0 && threads > hw_threads) threads = hw_threads;
+        return std::max(static_cast<int>(threads), 1);
+    }
+
+    /*
+    * keeps a decoded frame alive while its planes are referenced downstream
+    */
+    class FFmpegFrameRef : public IDecBufRef {
+    public:
+        explicit FFmpegFrameRef(AVFrame* frame) : frame_(frame) {}
+        ~FFmpegFrameRef() {
+            if (frame_) av_frame_free(&frame_);
+        }
+
+    private:
+        AVFrame* frame_ = nullptr;
+    };
+
     //----------------------------------------------------------------------------
     // CPU decoder
     bool FFmpegCpuDecoder::Create(VideoInfo* info, ExtraDecoderInfo* extra) {
@@ -56,15 +126,46 @@ namespace easysa {
             instance_->extradata_size = extra->extra_info.size();
         }
 
+        int wanted_threads = extra->decoder_threads;
+        if (wanted_threads <= 0) {
+            wanted_threads = AutoDecoderThreads(info->width, info->height);
+        }
+        threads_ = AcquireDecoderThreads(wanted_threads);
+        instance_->thread_count = threads_;
+        if (extra->thread_type) {
+            instance_->thread_type = extra->thread_type;
+        }
+        if (threads_ != wanted_threads) {
+            LOG(WARNING) << "[source]: " << "[" << stream_id_ << "]: "
+                << "decoder threads limited to " << threads_ << " (wanted " << wanted_threads << ")";
+        }
+
+        keep_frame_ref_ = extra->keep_frame_ref;
+        if (keep_frame_ref_) {
+            // decoded buffers must outlive the next decode call
+            instance_->refcounted_frames = 1;
+        }
+
+        skip_frame_ = extra->keyframe_only ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+        instance_->skip_frame = skip_frame_;
+
         if (avcodec_open2(instance_, dec, NULL) < 0) {
             LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: "
                 << "Failed to open codec";
+            av_free(instance_);
+            instance_ = nullptr;
+            ReleaseDecoderThreads(threads_);
+            threads_ = 0;
             return false;
         }
         av_frame_ = av_frame_alloc();
         if (!av_frame_) {
             LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: "
                 << "Could not alloc frame";
+            avcodec_close(instance_), av_free(instance_);
+            instance_ = nullptr;
+            ReleaseDecoderThreads(threads_);
+            threads_ = 0;
             return false;
         }
         eos_got_.store(0);
@@ -89,6 +190,10 @@ namespace easysa {
             av_frame_free(&av_frame_);
             av_frame_ = nullptr;
         }
+        if (threads_) {
+            ReleaseDecoderThreads(threads_);
+            threads_ = 0;
+        }
         LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: Finish destroy decoder";
     }
 
@@ -99,11 +204,97 @@ namespace easysa {
             packet.data = pkt->data;
             packet.size = pkt->len;
             packet.pts = pkt->pts;
-            return Process(&packet, false);
+            if (pkt->flags & VideoEsPacket::FLAG_KEY_FRAME) packet.flags |= AV_PKT_FLAG_KEY;
+            // skip_frame is checked per picture, so it can be switched packet by packet
+            instance_->skip_frame = (pkt->flags & VideoEsPacket::FLAG_DROPPABLE) ?
+                std::max(skip_frame_, AVDISCARD_NONREF) : skip_frame_;
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_SEND_RECEIVE
+            if (pkt->owner) {
+                // a refcounted packet is referenced by the decoder, otherwise avcodec_send_packet copies it
+                std::shared_ptr<void>* owner = new (std::nothrow) std::shared_ptr<void>(pkt->owner);
+                if (owner) {
+                    packet.buf = av_buffer_create(pkt->data, pkt->len + AV_INPUT_BUFFER_PADDING_SIZE,
+                        &FFmpegCpuDecoder::ReleaseOwner, owner, AV_BUFFER_FLAG_READONLY);
+                    if (!packet.buf) delete owner;
+                }
+            }
+#endif
+            bool ret = Process(&packet, false);
+            av_buffer_unref(&packet.buf);
+            return ret;
         }
         return Process(nullptr, true);
     }
 
+    void FFmpegCpuDecoder::ReleaseOwner(void* opaque, uint8_t* data) {
+        delete static_cast<std::shared_ptr<void>*>(opaque);
+    }
+
+    void FFmpegCpuDecoder::Flush() {
+        if (!instance_ || eos_sent_.load()) return;
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_SEND_RECEIVE
+        avcodec_send_packet(instance_, nullptr);
+        ReceiveFrames();
+#else
+        AVPacket packet;
+        av_init_packet(&packet);
+        packet.size = 0;
+        packet.data = NULL;
+        int got_frame = 0;
+        do {
+            avcodec_decode_video2(instance_, av_frame_, &got_frame, &packet);
+            if (got_frame) ProcessFrame(av_frame_);
+            if (got_frame && keep_frame_ref_) av_frame_unref(av_frame_);
+        } while (got_frame);
+#endif
+        // leave the draining state
+        avcodec_flush_buffers(instance_);
+    }
+
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_SEND_RECEIVE
+    bool FFmpegCpuDecoder::ReceiveFrames() {
+        // all frames ready are delivered in one go, frame threading may release several at once
+        while (true) {
+            int ret = avcodec_receive_frame(instance_, av_frame_);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return true;
+            if (ret < 0) {
+                LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: "
+                    << "avcodec_receive_frame failed, ret: " << ret;
+                return false;
+            }
+            ProcessFrame(av_frame_);
+            av_frame_unref(av_frame_);
+        }
+    }
+
+    bool FFmpegCpuDecoder::Process(AVPacket* pkt, bool eos) {
+        if (eos) {
+            LOG(INFO) << "[source]: " << "[" << stream_id_ << "]: Sent EOS packet to decoder";
+            eos_sent_.store(1);
+            // enter draining mode, then flush all frames ...
+            avcodec_send_packet(instance_, nullptr);
+            ReceiveFrames();
+            if (result_) {
+                result_->OnDecodeEos();
+            }
+            eos_got_.store(1);
+            return false;
+        }
+        int ret = avcodec_send_packet(instance_, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            // the output must be read before the decoder takes more input
+            ReceiveFrames();
+            ret = avcodec_send_packet(instance_, pkt);
+        }
+        if (ret < 0) {
+            LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: "
+                << "avcodec_send_packet failed, data ptr, size:" << pkt->data << ", " << pkt->size;
+            return true;
+        }
+        ReceiveFrames();
+        return true;
+    }
+#else
     bool FFmpegCpuDecoder::Process(AVPacket* pkt, bool eos) {
         if (eos) {
             AVPacket packet;
@@ -118,6 +309,7 @@ namespace easysa {
             do {
                 avcodec_decode_video2(instance_, av_frame_, &got_frame, &packet);
                 if (got_frame) ProcessFrame(av_frame_);
+                if (got_frame && keep_frame_ref_) av_frame_unref(av_frame_);
             } while (got_frame);
 
             if (result_) {
@@ -138,9 +330,11 @@ namespace easysa {
 #endif
         if (got_frame) {
             ProcessFrame(av_frame_);
+            if (keep_frame_ref_) av_frame_unref(av_frame_);
         }
         return true;
     }
+#endif
 
 
     bool FFmpegCpuDecoder::ProcessFrame(AVFrame* frame) {
@@ -182,11 +376,22 @@ namespace easysa {
         }
         }
         cn_frame.cuda_addr = false;
+        cn_frame.buf_ref = nullptr;
+        if (keep_frame_ref_) {
+            // a fresh frame per output, so the decoder never writes into buffers still in use
+            AVFrame* ref = av_frame_alloc();
+            if (ref && av_frame_ref(ref, frame) == 0) {
+                cn_frame.buf_ref.reset(new FFmpegFrameRef(ref));
+                frame = ref;
+            }
+            else if (ref) {
+                av_frame_free(&ref);
+            }
+        }
         for (int i = 0; i < cn_frame.planeNum; i++) {
             cn_frame.stride[i] = frame->linesize[i];
             cn_frame.plane[i] = frame->data[i];
         }
-        cn_frame.buf_ref = nullptr;
         if (result_) {
             result_->OnDecodeFrame(&cn_frame);
         }
@@ -56,8 +56,20 @@ namespace easysa {
         int32_t max_height = 0;  // for jpu
         */
         std::vector<uint8_t> extra_info;
+        int32_t decoder_threads = 1;  // 0 means sizing it from the coded resolution
+        int32_t thread_type = 0;  // FF_THREAD_FRAME and/or FF_THREAD_SLICE, 0 keeps the codec default
+        bool keep_frame_ref = false;  // hand out a reference of every decoded frame by DecodeFrame::buf_ref
+        bool keyframe_only = false;  // discard all non-key frames inside the decoder
     };
 
+    /*
+    * process-wide cap on the threads used by all cpu decoders, 0 means no cap.
+    * Every decoder gets at least one thread whatever the cap is.
+    */
+    void SetDecoderThreadLimit(int limit);
+    int GetDecoderThreadLimit();
+    int GetDecoderThreadsInUse();
+
     // FIXME
     enum DecodeErrorCode {
         ERROR_FAILED_TO_START,
@@ -81,6 +93,11 @@ namespace easysa {
         virtual bool Create(VideoInfo* info, ExtraDecoderInfo* extra = nullptr) = 0;
         virtual bool Process(VideoEsPacket* pkt) = 0;
         virtual void Destroy() = 0;
+        /*
+        * outputs the frames still held by the decoder and resets it for a new sequence,
+        * without EOS, e.g. after the input is rewound.
+        */
+        virtual void Flush() {}
 
     protected:
         std::string stream_id_ = "";
@@ -94,6 +111,7 @@ namespace easysa {
         bool Create(VideoInfo* info, ExtraDecoderInfo* extra = nullptr) override;
         void Destroy() override;
         bool Process(VideoEsPacket* pkt) override;
+        void Flush() override;
 
     private:
 #ifdef UNIT_TEST
@@ -102,10 +120,15 @@ namespace easysa {
 #endif
         bool ProcessFrame(AVFrame* frame);
         bool Process(AVPacket* pkt, bool eos);
+        bool ReceiveFrames();
+        static void ReleaseOwner(void* opaque, uint8_t* data);
 
     private:
         AVCodecContext* instance_ = nullptr;
         AVFrame* av_frame_ = nullptr;
+        int threads_ = 0;  // threads taken from the process-wide budget
+        bool keep_frame_ref_ = false;
+        AVDiscard skip_frame_ = AVDISCARD_DEFAULT;
         std::atomic<int> eos_got_{ 0 };
         std::atomic<int> eos_sent_{ 0 };
 
@@ -6,8 +6,10 @@
  *     http://www.apache.org/licenses/LICENSE-2.0
  *
  *************************************************************************/
+#include <algorithm>
 #include <iostream>
 #include <mutex>
+#include <string>
 #include <vector>
 #if defined(__linux) || defined(__unix)
 #include <ctime>
@@ -15,6 +17,8 @@
 #include <windows.h>
 #endif
 #include <glog/logging.h>
+#include "mmap_io.hpp"
+#include "probe_cache.hpp"
 #include "video_parser.hpp"
 
 namespace easysa {
@@ -31,6 +35,9 @@ namespace easysa {
      * */
 
 #define FFMPEG_VERSION_2_8 AV_VERSION_INT(56, 56, 100)
+#if LIBAVCODEC_VERSION_INT < FFMPEG_VERSION_2_8
+#define AV_INPUT_BUFFER_PADDING_SIZE FF_INPUT_BUFFER_PADDING_SIZE
+#endif
 
      /**
       * FFMPEG use AVCodecParameters instead of AVCodecContext
@@ -39,6 +46,13 @@ namespace easysa {
 
 #define FFMPEG_VERSION_3_1 AV_VERSION_INT(57, 40, 100)
 
+     /**
+      * FFMPEG use AVBSFContext instead of AVBitStreamFilterContext
+      * since from version 3.1(libavcodec/version:57.48.101)
+      **/
+
+#define FFMPEG_VERSION_BSF AV_VERSION_INT(57, 48, 101)
+
     struct local_ffmpeg_init {
         local_ffmpeg_init() {
             avcodec_register_all();
@@ -76,7 +90,12 @@ namespace easysa {
             return false;
         }
 
-        int Open(const std::string& url, IParserResult* result) {
+        static bool IsLocalFile(const std::string& url) {
+            if (url.compare(0, 5, "file:") == 0) return true;
+            return url.find("://") == std::string::npos;
+        }
+
+        int Open(const std::string& url, IParserResult* result, const FFParserParam& param) {
             std::unique_lock<std::mutex> guard(mutex_);
             if (!result) return -1;
             result_ = result;
@@ -84,6 +103,24 @@ namespace easysa {
             fmt_ctx_ = avformat_alloc_context();
             if (!fmt_ctx_) return -1;
             url_name_ = url;
+            if (param.use_mmap && IsLocalFile(url)) {
+                std::string path = url.compare(0, 5, "file:") == 0 ? url.substr(5) : url;
+                std::shared_ptr<MappedFile> file = MappedFile::Open(path);
+                if (file) {
+                    mmap_io_.reset(new MmapIOContext(file));
+                    if (mmap_io_->Init()) {
+                        fmt_ctx_->pb = mmap_io_->GetIOContext();
+                        fmt_ctx_->flags |= AVFMT_FLAG_CUSTOM_IO;
+                    }
+                    else {
+                        mmap_io_.reset();
+                    }
+                }
+                if (!mmap_io_) {
+                    LOG(WARNING) << "[source]: " << "[" << stream_id_ << "]: mmap io unavailable, fall back to file io -- "
+                        << url_name_;
+                }
+            }
             AVInputFormat* ifmt = NULL;
 #if HAVE_FFMPEG_AVDEVICE
             // open v4l2 input
@@ -109,17 +146,30 @@ namespace easysa {
             av_dict_set(&options_, "max_delay", "500000", 0);
 
 #endif
+            if (param.probesize > 0) {
+                av_dict_set(&options_, "probesize", std::to_string(param.probesize).c_str(), 0);
+            }
+            if (param.analyzeduration > 0) {
+                av_dict_set(&options_, "analyzeduration", std::to_string(param.analyzeduration).c_str(), 0);
+            }
             // open input
             ret_code = avformat_open_input(&fmt_ctx_, url_name_.c_str(), ifmt, &options_);
             if (0 != ret_code) {
                 LOG(INFO) << "[source]: " << "[" << stream_id_ << "]: Couldn't open input stream -- " << url_name_;
                 return -1;
             }
-            // find video stream information
-            ret_code = avformat_find_stream_info(fmt_ctx_, NULL);
-            if (ret_code < 0) {
-                LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: Couldn't find stream information -- " << url_name_;
-                return -1;
+            // find video stream information, sources probed before use the cached result
+            std::shared_ptr<ProbeCache> probe_cache = ProbeCache::Get(param.probe_cache);
+            std::string probe_key = probe_cache ? ProbeCache::MakeKey(url_name_) : "";
+            ProbeInfo probe_info;
+            bool probe_hit = !probe_key.empty() && probe_cache->Lookup(probe_key, &probe_info) &&
+                ApplyProbeInfo(probe_info);
+            if (!probe_hit) {
+                ret_code = avformat_find_stream_info(fmt_ctx_, NULL);
+                if (ret_code < 0) {
+                    LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: Couldn't find stream information -- " << url_name_;
+                    return -1;
+                }
             }
             // 2. init read packet handler
             // fill info (get packet data)
@@ -144,12 +194,19 @@ namespace easysa {
                 return -1;
             }
             video_index_ = video_index;
+            if (!probe_hit && !probe_key.empty()) {
+                StoreProbeInfo(probe_cache.get(), probe_key);
+            }
 
 #if LIBAVFORMAT_VERSION_INT >= FFMPEG_VERSION_3_1
             info->codec_id = st->codecpar->codec_id;
+            info->width = st->codecpar->width;
+            info->height = st->codecpar->height;
             int field_order = st->codecpar->field_order;
 #else
             info->codec_id = st->codec->codec_id;
+            info->width = st->codec->width;
+            info->height = st->codec->height;
             int field_order = st->codec->field_order;
 #endif
 
@@ -184,20 +241,28 @@ namespace easysa {
             bsf_ctx_ = nullptr;
             if (strstr(fmt_ctx_->iformat->name, "mp4") || strstr(fmt_ctx_->iformat->name, "flv") ||
                 strstr(fmt_ctx_->iformat->name, "matroska")) {
+                const char* bsf_name = nullptr;
                 if (AV_CODEC_ID_H264 == info->codec_id) {
-                    bsf_ctx_ = av_bitstream_filter_init("h264_mp4toannexb");
+                    bsf_name = "h264_mp4toannexb";
                 }
                 else if (AV_CODEC_ID_HEVC == info->codec_id) {
-                    bsf_ctx_ = av_bitstream_filter_init("hevc_mp4toannexb");
+                    bsf_name = "hevc_mp4toannexb";
                 }
-                else {
-                    bsf_ctx_ = nullptr;
+                if (bsf_name && !InitBsf(bsf_name, st)) {
+                    LOG(ERROR) << "[source]: " << "[" << stream_id_ << "]: Init bitstream filter " << bsf_name
+                        << " failed -- " << url_name_;
+                    return -1;
                 }
             }
             if (result_) {
                 result_->OnParserInfo(info);
             }
             av_init_packet(&packet_);
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+            if (!bsf_packet_) bsf_packet_ = av_packet_alloc();
+            if (!bsf_packet_) return -1;
+            bsf_draining_ = false;
+#endif
             first_frame_ = true;
             eos_reached_ = false;
             open_success_ = true;
@@ -211,12 +276,22 @@ namespace easysa {
                 avformat_free_context(fmt_ctx_);
                 av_dict_free(&options_);
                 if (bsf_ctx_) {
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+                    av_bsf_free(&bsf_ctx_);
+#else
                     av_bitstream_filter_close(bsf_ctx_);
+#endif
                     bsf_ctx_ = nullptr;
                 }
                 options_ = nullptr;
                 fmt_ctx_ = nullptr;
             }
+            // custom io is not freed by avformat_close_input
+            mmap_io_.reset();
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+            av_packet_free(&bsf_packet_);
+            bsf_draining_ = false;
+#endif
             first_frame_ = true;
             eos_reached_ = false;
             open_success_ = false;
@@ -228,8 +303,32 @@ namespace easysa {
                 return -1;
             }
             while (true) {
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+                if (bsf_ctx_) {
+                    // one packet in may give any number out, take what the filter holds before reading more
+                    int ret = av_bsf_receive_packet(bsf_ctx_, bsf_packet_);
+                    if (ret == 0) return Output(bsf_packet_);
+                    if (ret == AVERROR_EOF) {
+                        if (result_) {
+                            result_->OnParserFrame(nullptr);
+                        }
+                        eos_reached_ = true;
+                        return -1;
+                    }
+                    if (ret != AVERROR(EAGAIN)) {
+                        LOG(WARNING) << "[source]: " << "[" << stream_id_ << "]: av_bsf_receive_packet failed";
+                    }
+                }
+#endif
                 last_receive_frame_time_ = GetTickCount();
                 if (av_read_frame(fmt_ctx_, &packet_) < 0) {
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+                    if (bsf_ctx_ && !bsf_draining_) {
+                        // drain the filter, eos follows its last packet
+                        bsf_draining_ = true;
+                        if (av_bsf_send_packet(bsf_ctx_, nullptr) == 0) continue;
+                    }
+#endif
                     if (result_) {
                         result_->OnParserFrame(nullptr);
                     }
@@ -242,7 +341,6 @@ namespace easysa {
                     continue;
                 }
 
-                AVStream* vstream = fmt_ctx_->streams[video_index_];
                 if (first_frame_) {
                     if (packet_.flags & AV_PKT_FLAG_KEY) {
                         first_frame_ = false;
@@ -254,43 +352,171 @@ namespace easysa {
                 }
 
                 if (bsf_ctx_) {
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+                    // the filter takes the packet reference, the output is received into a reused packet
+                    if (av_bsf_send_packet(bsf_ctx_, &packet_) < 0) {
+                        av_packet_unref(&packet_);
+                        LOG(WARNING) << "[source]: " << "[" << stream_id_ << "]: av_bsf_send_packet failed";
+                    }
+                    continue;
+#else
+                    AVStream* vstream = fmt_ctx_->streams[video_index_];
                     av_bitstream_filter_filter(bsf_ctx_, vstream->codec, NULL, &packet_.data, &packet_.size,
                         packet_.data, packet_.size, 0);
+#endif
                 }
-                // find pts information
-                if (AV_NOPTS_VALUE == packet_.pts && find_pts_) {
-                    find_pts_ = false;
-                    // LOGW(SOURCE) << "Didn't find pts informations, "
-                    //              << "use ordered numbers instead. "
-                    //              << "stream url: " << url_name_.c_str();
-                }
-                else if (AV_NOPTS_VALUE != packet_.pts) {
-                    find_pts_ = true;
-                    packet_.pts = av_rescale_q(packet_.pts, vstream->time_base, { 1, 90000 });
-                }
-                if (!find_pts_) {
-                    packet_.pts = pts_++;  // FIXME
-                }
+                return Output(&packet_);
+            }
+        }
 
-                if (result_) {
-                    VideoEsFrame frame;
-                    frame.flags = packet_.flags;
-                    frame.data = packet_.data;
-                    frame.len = packet_.size;
-                    frame.pts = packet_.pts;
-                    result_->OnParserFrame(&frame);
-                }
-                if (bsf_ctx_) {
-                    av_freep(&packet_.data);
+        /*
+        * seeks back to the start of the file, keeps the format context and flushes the bitstream filter.
+        * pts of the next pass continue after the last one.
+        */
+        int Rewind() {
+            std::unique_lock<std::mutex> guard(mutex_);
+            if (!open_success_ || !fmt_ctx_) return -1;
+            AVStream* vstream = fmt_ctx_->streams[video_index_];
+            int64_t start = vstream->start_time != AV_NOPTS_VALUE ? vstream->start_time : 0;
+            if (av_seek_frame(fmt_ctx_, video_index_, start, AVSEEK_FLAG_BACKWARD) < 0) {
+                LOG(WARNING) << "[source]: " << "[" << stream_id_ << "]: Seek to start failed -- " << url_name_;
+                return -1;
+            }
+            if (AV_NOPTS_VALUE != pass_first_pts_) {
+                int64_t frame_duration = 1;
+                if (vstream->avg_frame_rate.num > 0 && vstream->avg_frame_rate.den > 0) {
+                    frame_duration = av_rescale_q(1, av_inv_q(vstream->avg_frame_rate), { 1, 90000 });
                 }
-                av_packet_unref(&packet_);
-                return 0;
+                pts_offset_ += pass_max_pts_ - pass_first_pts_ + std::max<int64_t>(frame_duration, 1);
             }
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+            // state left from the end of the last pass, or its drain, must not reach the next one
+            if (bsf_ctx_) av_bsf_flush(bsf_ctx_);
+            bsf_draining_ = false;
+#endif
+            pass_first_pts_ = AV_NOPTS_VALUE;
+            pass_max_pts_ = 0;
+            first_frame_ = true;
+            eos_reached_ = false;
+            return 0;
+        }
+
+    private:
+        /*
+        * fills what the demuxer header does not tell from the cached probe result,
+        * returns false if the cached stream does not match, the input is probed then.
+        */
+        bool ApplyProbeInfo(const ProbeInfo& probe) {
+#if LIBAVFORMAT_VERSION_INT >= FFMPEG_VERSION_3_1
+            if (probe.stream_index < 0 || probe.stream_index >= static_cast<int>(fmt_ctx_->nb_streams)) return false;
+            AVStream* st = fmt_ctx_->streams[probe.stream_index];
+            AVCodecParameters* par = st->codecpar;
+            if (par->codec_type != AVMEDIA_TYPE_VIDEO) return false;
+            if (par->codec_id != AV_CODEC_ID_NONE && par->codec_id != probe.codec_id) return false;
+            par->codec_id = static_cast<AVCodecID>(probe.codec_id);
+            if (par->width <= 0 || par->height <= 0) {
+                par->width = probe.width;
+                par->height = probe.height;
+            }
+            par->field_order = static_cast<AVFieldOrder>(probe.field_order);
+            if (!par->extradata_size && !probe.extra_data.empty()) {
+                par->extradata = static_cast<uint8_t*>(
+                    av_mallocz(probe.extra_data.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+                if (!par->extradata) return false;
+                memcpy(par->extradata, probe.extra_data.data(), probe.extra_data.size());
+                par->extradata_size = static_cast<int>(probe.extra_data.size());
+            }
+            if (st->avg_frame_rate.num <= 0 && probe.frame_rate_num > 0 && probe.frame_rate_den > 0) {
+                st->avg_frame_rate = { probe.frame_rate_num, probe.frame_rate_den };
+            }
+            LOG(INFO) << "[source]: " << "[" << stream_id_ << "]: Use cached probe result -- " << url_name_;
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        void StoreProbeInfo(ProbeCache* cache, const std::string& key) {
+#if LIBAVFORMAT_VERSION_INT >= FFMPEG_VERSION_3_1
+            AVStream* st = fmt_ctx_->streams[video_index_];
+            ProbeInfo probe;
+            probe.stream_index = video_index_;
+            probe.codec_id = st->codecpar->codec_id;
+            probe.width = st->codecpar->width;
+            probe.height = st->codecpar->height;
+            probe.field_order = st->codecpar->field_order;
+            probe.frame_rate_num = st->avg_frame_rate.num;
+            probe.frame_rate_den = st->avg_frame_rate.den;
+            if (st->codecpar->extradata && st->codecpar->extradata_size > 0) {
+                probe.extra_data.assign(st->codecpar->extradata, st->codecpar->extradata + st->codecpar->extradata_size);
+            }
+            cache->Store(key, probe);
+#endif
+        }
+
+        // hands one packet to the result and releases it; called with the mutex held
+        int Output(AVPacket* out) {
+            AVStream* vstream = fmt_ctx_->streams[video_index_];
+            // find pts information
+            if (AV_NOPTS_VALUE == out->pts && find_pts_) {
+                find_pts_ = false;
+                // LOGW(SOURCE) << "Didn't find pts informations, "
+                //              << "use ordered numbers instead. "
+                //              << "stream url: " << url_name_.c_str();
+            }
+            else if (AV_NOPTS_VALUE != out->pts) {
+                find_pts_ = true;
+                out->pts = av_rescale_q(out->pts, vstream->time_base, { 1, 90000 });
+                if (AV_NOPTS_VALUE == pass_first_pts_) pass_first_pts_ = out->pts;
+                pass_max_pts_ = std::max(pass_max_pts_, out->pts);
+                out->pts += pts_offset_;
+            }
+            if (!find_pts_) {
+                out->pts = pts_++;  // FIXME
+            }
+
+            if (result_) {
+                VideoEsFrame frame;
+                frame.flags = out->flags;
+                if (!find_pts_) frame.flags |= VideoEsFrame::FLAG_NO_PTS;
+                frame.data = out->data;
+                frame.len = out->size;
+                frame.pts = out->pts;
+                result_->OnParserFrame(&frame);
+            }
+#if LIBAVCODEC_VERSION_INT < FFMPEG_VERSION_BSF
+            if (bsf_ctx_) {
+                av_freep(&out->data);
+            }
+#endif
+            av_packet_unref(out);
+            return 0;
+        }
+
+        bool InitBsf(const char* name, AVStream* st) {
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+            const AVBitStreamFilter* filter = av_bsf_get_by_name(name);
+            if (!filter || av_bsf_alloc(filter, &bsf_ctx_) < 0) return false;
+            bsf_ctx_->time_base_in = st->time_base;
+            if (avcodec_parameters_copy(bsf_ctx_->par_in, st->codecpar) < 0 || av_bsf_init(bsf_ctx_) < 0) {
+                av_bsf_free(&bsf_ctx_);
+                return false;
+            }
+#else
+            bsf_ctx_ = av_bitstream_filter_init(name);
+#endif
+            return bsf_ctx_ != nullptr;
         }
 
     private:
         AVFormatContext* fmt_ctx_ = nullptr;
+#if LIBAVCODEC_VERSION_INT >= FFMPEG_VERSION_BSF
+        AVBSFContext* bsf_ctx_ = nullptr;
+        AVPacket* bsf_packet_ = nullptr;  // reused for every filtered packet
+        bool bsf_draining_ = false;  // end of input was sent to the filter
+#else
         AVBitStreamFilterContext* bsf_ctx_ = nullptr;
+#endif
         AVDictionary* options_ = NULL;
         bool first_frame_ = true;
         int video_index_ = -1;
@@ -298,10 +524,15 @@ namespace easysa {
         uint8_t max_receive_time_out_ = 3;
         bool find_pts_ = false;
         uint64_t pts_ = 0;
+        // pts rebase over rewinds, in 1/90000 second
+        int64_t pts_offset_ = 0;
+        int64_t pass_first_pts_ = AV_NOPTS_VALUE;
+        int64_t pass_max_pts_ = 0;
         std::string stream_id_ = "";
         std::string url_name_;
         IParserResult* result_ = nullptr;
         AVPacket packet_;
+        std::unique_ptr<MmapIOContext> mmap_io_;
         bool eos_reached_ = false;
         bool open_success_ = false;
         std::mutex mutex_;
@@ -315,9 +546,9 @@ namespace easysa {
         if (impl_) delete impl_, impl_ = nullptr;
     }
 
-    int FFParser::Open(const std::string& url, IParserResult* result) {
+    int FFParser::Open(const std::string& url, IParserResult* result, const FFParserParam& param) {
         if (impl_) {
-            return impl_->Open(url, result);
+            return impl_->Open(url, result, param);
         }
         return -1;
     }
@@ -328,9 +559,16 @@ namespace easysa {
         }
     }
 
+    int FFParser::Rewind() {
+        if (impl_) {
+            return impl_->Rewind();
+        }
+        return -1;
+    }
+
     int FFParser::Parse() {
         if (impl_) {
-            impl_->Parse();
+            return impl_->Parse();
         }
         return -1;
     }
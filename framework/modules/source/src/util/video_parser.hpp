@@ -39,6 +39,8 @@ namespace easysa {
 	struct VideoInfo {
 		AVCodecID codec_id;
 		int progressive;
+		int width = 0;  // coded size, 0 if the demuxer did not report it
+		int height = 0;
 		std::vector<unsigned char> extra_data;
 	};
 
@@ -49,7 +51,8 @@ namespace easysa {
 		size_t len = 0;
 		int64_t pts = 0;
 		uint32_t flags = 0;
-		enum { FLAG_KEY_FRAME = 0x01 };
+		// FLAG_NO_PTS: the stream has no pts, pts are frame numbers
+		enum { FLAG_KEY_FRAME = 0x01, FLAG_NO_PTS = 0x100 };
 		bool IsEos();
 	};
 
@@ -69,6 +72,24 @@ namespace easysa {
 		uint8_t* data = nullptr;
 		size_t len = 0;
 		int64_t pts = -1;
+		uint32_t flags = 0;
+		/*
+		* FLAG_DROPPABLE: the frame of this packet is not wanted, the decoder may skip it
+		* when it is not referenced by other frames.
+		*/
+		enum { FLAG_KEY_FRAME = 0x01, FLAG_DROPPABLE = 0x02 };
+		/*
+		* set if data is owned by the caller and refcounted, the decoder then references it instead of
+		* copying. data must be followed by AV_INPUT_BUFFER_PADDING_SIZE readable bytes.
+		*/
+		std::shared_ptr<void> owner = nullptr;
+	};
+
+	struct FFParserParam {
+		bool use_mmap = false;  // read local files through a shared memory mapping
+		int64_t probesize = 0;  // bytes read to probe the stream, 0 uses the FFmpeg default
+		int64_t analyzeduration = 0;  // microseconds analyzed to probe the stream, 0 uses the FFmpeg default
+		std::string probe_cache;  // file keeping probe results, known sources are not probed, empty disables it
 	};
 
 	// FFmpeg demuxer and parser
@@ -77,9 +98,13 @@ namespace easysa {
 	public:
 		explicit FFParser(const std::string& stream_id);
 		~FFParser();
-		int Open(const std::string& url, IParserResult* result);
+		int Open(const std::string& url, IParserResult* result, const FFParserParam& param = FFParserParam());
 		void Close();
 		int Parse();
+		/*
+		* seeks back to the start without reopening, returns -1 if the input can not seek
+		*/
+		int Rewind();
 
 	private:
 		FFParser(const FFParser&) = delete;
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include "easysa_allocator.hpp"
+
+namespace easysa {
+	TEST(CoreAllocator, PoolReuse) {
+		auto pool = std::make_shared<PooledCpuAllocator>();
+		void* p = pool->alloc(1000);
+		ASSERT_NE(p, nullptr);
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0u);
+		memset(p, 0, 1000);
+		pool->free(p);
+		// same size class, served by the thread cache
+		void* q = pool->alloc(1020);
+		EXPECT_EQ(q, p);
+		pool->free(q);
+		PooledCpuAllocator::Stats stats = pool->GetStats();
+		EXPECT_EQ(stats.hits, 1u);
+		EXPECT_EQ(stats.misses, 1u);
+
+		std::shared_ptr<void> data = MemAlloc(100 << 20, pool);  // not pooled
+		ASSERT_NE(data, nullptr);
+		data.reset();
+		EXPECT_LT(pool->GetStats().total_bytes, size_t(100 << 20));
+	}
+
+	TEST(CoreAllocator, PoolLimit) {
+		PooledCpuAllocator::Config config;
+		config.max_bytes = 1 << 20;
+		config.thread_cache_bytes = 0;
+		auto pool = std::make_shared<PooledCpuAllocator>(config);
+		void* p = pool->alloc(768 << 10);
+		ASSERT_NE(p, nullptr);
+		EXPECT_EQ(pool->alloc(768 << 10), nullptr);
+		EXPECT_EQ(pool->alloc(768 << 10, 10), nullptr);
+
+		std::thread releaser([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			pool->free(p);
+		});
+		void* q = pool->alloc(700 << 10, 5000);
+		EXPECT_NE(q, nullptr);
+		releaser.join();
+		pool->free(q);
+
+		// a cached block of another class is reclaimed to make room
+		void* r = pool->alloc(850 << 10);
+		EXPECT_NE(r, nullptr);
+		pool->free(r);
+	}
+
+	TEST(CoreAllocator, PoolReclaimThreadCache) {
+		PooledCpuAllocator::Config config;
+		config.max_bytes = 1 << 20;
+		auto pool = std::make_shared<PooledCpuAllocator>(config);
+		void* p = pool->alloc(768 << 10);
+		ASSERT_NE(p, nullptr);
+		void* small = pool->alloc(1000);
+		ASSERT_NE(small, nullptr);
+
+		// a consumer frees the block into its own cache, where the producer cannot reuse it
+		std::promise<void> freed;
+		std::promise<void> next;
+		std::thread consumer([&]() {
+			pool->free(p);
+			freed.set_value();
+			next.get_future().wait();
+			pool->free(small);  // the next call gives the cached block back
+		});
+		freed.get_future().wait();
+		EXPECT_EQ(pool->GetStats().cached_bytes, 0u);
+		EXPECT_EQ(pool->alloc(900 << 10), nullptr);
+
+		std::thread waker([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			next.set_value();
+		});
+		void* q = pool->alloc(900 << 10, 5000);
+		EXPECT_NE(q, nullptr);
+		waker.join();
+		consumer.join();
+		pool->free(q);
+
+		// Reclaim() reaches the cache of this thread on its next call
+		void* r = pool->alloc(1000);
+		ASSERT_NE(r, nullptr);
+		pool->free(r);
+		uint64_t misses = pool->GetStats().misses;
+		pool->Reclaim();
+		r = pool->alloc(1000);
+		ASSERT_NE(r, nullptr);
+		EXPECT_EQ(pool->GetStats().misses, misses + 1);
+		EXPECT_LT(pool->GetStats().total_bytes, size_t(64 << 10));  // only r is left
+		pool->free(r);
+	}
+
+	TEST(CoreAllocator, PoolSetLimits) {
+		PooledCpuAllocator::Config config;
+		config.thread_cache_bytes = 0;
+		auto pool = std::make_shared<PooledCpuAllocator>(config);
+		std::shared_ptr<void> first = MemAlloc(768 << 10, pool);
+		ASSERT_NE(first, nullptr);
+		pool->SetLimits(1 << 20, 256 << 20);
+		EXPECT_EQ(MemAlloc(768 << 10, pool), nullptr);
+		EXPECT_EQ(MemAlloc(768 << 10, pool, 10), nullptr);
+
+		// a bounded caller waits for memory instead of failing
+		std::thread releaser([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			first.reset();
+		});
+		std::shared_ptr<void> second = MemAlloc(768 << 10, pool, 5000);
+		EXPECT_NE(second, nullptr);
+		releaser.join();
+
+		// lifting the limit wakes a waiting caller
+		std::thread lifter([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			pool->SetLimits(0, 256 << 20);
+		});
+		std::shared_ptr<void> third = MemAlloc(768 << 10, pool, -1);
+		EXPECT_NE(third, nullptr);
+		lifter.join();
+
+		second.reset();
+		third.reset();
+		pool->SetLimits(0, 0);  // frees the cached blocks
+		EXPECT_EQ(pool->GetStats().total_bytes, 0u);
+	}
+
+	TEST(CoreAllocator, PoolHugePages) {
+		PooledCpuAllocator::Config config;
+		config.huge_pages = true;
+		config.prefault = true;
+		config.thread_cache_bytes = 0;
+		auto pool = std::make_shared<PooledCpuAllocator>(config);
+		const size_t frame_bytes = 3840 * 2160 * 3 / 2;
+		std::shared_ptr<void> frame = MemAlloc(frame_bytes, pool);
+		ASSERT_NE(frame, nullptr);
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(frame.get()) % 64, 0u);
+		memset(frame.get(), 1, frame_bytes);
+#ifdef __linux__
+		EXPECT_GE(pool->GetStats().huge_bytes, frame_bytes);
+#endif
+		// small blocks are never mapped
+		void* p = pool->alloc(4096);
+		ASSERT_NE(p, nullptr);
+		pool->free(p);
+
+		frame.reset();
+		pool->Reclaim();
+		EXPECT_EQ(pool->GetStats().huge_bytes, 0u);
+		EXPECT_EQ(pool->GetStats().total_bytes, 0u);
+	}
+}  // namespace easysa
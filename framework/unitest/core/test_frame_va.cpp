@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "easysa_frame_va.hpp"
+
+namespace easysa {
+	// a reddish NV12 frame, planes laid out one after another as the source module writes them
+	static void FillNV12Frame(DataFrame* frame, std::vector<uint8_t>* buffer, int width, int height) {
+		buffer->assign(static_cast<size_t>(width) * height * 3 / 2, 0);
+		uint8_t* y = buffer->data();
+		uint8_t* uv = y + width * height;
+		memset(y, 100, static_cast<size_t>(width) * height);
+		for (int i = 0; i < width * height / 2; i += 2) {
+			uv[i] = 90;       // U, less blue
+			uv[i + 1] = 200;  // V, more red
+		}
+		frame->fmt = PIXEL_FORMAT_YUV420_NV12;
+		frame->width = width;
+		frame->height = height;
+		frame->stride[0] = frame->stride[1] = width;
+		frame->ptr_cpu[0] = y;
+		frame->ptr_cpu[1] = uv;
+		frame->ptr_cpu[2] = nullptr;
+	}
+
+	TEST(CoreFrameVa, NV12ToBGR) {
+		DataFrame frame;
+		std::vector<uint8_t> buffer;
+		FillNV12Frame(&frame, &buffer, 32, 16);
+
+		cv::Mat* bgr = frame.ImageBGR();
+		ASSERT_NE(bgr, nullptr);
+		EXPECT_TRUE(frame.HasBGRImage());
+		EXPECT_EQ(bgr->cols, 32);
+		EXPECT_EQ(bgr->rows, 16);
+		EXPECT_EQ(bgr->type(), CV_8UC3);
+		cv::Vec3b pixel = bgr->at<cv::Vec3b>(8, 16);
+		EXPECT_GT(pixel[2], pixel[0]);  // red over blue
+		EXPECT_EQ(frame.ImageBGR(), bgr);  // converted once
+
+		cv::Mat* rgb = frame.ImageRGB();
+		ASSERT_NE(rgb, nullptr);
+		cv::Vec3b swapped = rgb->at<cv::Vec3b>(8, 16);
+		EXPECT_EQ(swapped[0], pixel[2]);
+		EXPECT_EQ(swapped[2], pixel[0]);
+
+		cv::Mat* planar = frame.ImagePlanarFloat(true);
+		ASSERT_NE(planar, nullptr);
+		EXPECT_EQ(planar->rows, 3 * 16);
+		EXPECT_EQ(planar->cols, 32);
+		EXPECT_FLOAT_EQ(planar->at<float>(8, 16), static_cast<float>(pixel[2]));
+
+		cv::Mat* scaled = frame.GetScaledImage(16, 8, PIXEL_FORMAT_BGR24, true);
+		ASSERT_NE(scaled, nullptr);
+		EXPECT_EQ(scaled->cols, 16);
+		EXPECT_EQ(scaled->rows, 8);
+	}
+
+	TEST(CoreFrameVa, ObjectsShareFrameTable) {
+		InferObjs objs;
+		auto face = objs.AddObject(InferBoundingBox{ 0.1f, 0.2f, 0.3f, 0.4f }, 0.9f);
+		auto body = objs.AddObject(InferBoundingBox{ 0.5f, 0.5f, 0.2f, 0.2f }, 0.8f, 3, 42);
+		ASSERT_EQ(objs.objs_.size(), 2u);
+		EXPECT_EQ(objs.table_->Size(), 2u);
+		EXPECT_EQ(face->GetTable(), objs.table_.get());
+		EXPECT_EQ(body->GetRow(), 1u);
+
+		// the handle and the table see the same row
+		EXPECT_FLOAT_EQ(face->GetBBox().w, 0.3f);
+		EXPECT_EQ(face->GetClassId(), -1);
+		EXPECT_EQ(body->GetClassId(), 3);
+		EXPECT_EQ(body->GetTrackId(), 42);
+		face->SetTrackId(7);
+		EXPECT_EQ(objs.table_->TrackIds()[face->GetRow()], 7);
+		EXPECT_EQ(objs.table_->ClassIds()[body->GetRow()], 3);
+		body->SetScore(0.6f);
+		EXPECT_FLOAT_EQ(objs.table_->GetScore(body->GetRow()), 0.6f);
+		EXPECT_TRUE(face->AddExtraAttribute("label", "face"));
+		EXPECT_EQ(objs.table_->GetExtraAttribute(face->GetRow(), "label"), "face");
+		EXPECT_TRUE(body->GetExtraAttribute("label").empty());
+		EXPECT_TRUE(face->AddFeature("pts", InferFeature{ 1.f, 2.f }));
+		EXPECT_EQ(objs.table_->GetFeature(face->GetRow(), "pts"), (InferFeature{ 1.f, 2.f }));
+
+		EXPECT_TRUE(face->RemoveExtraAttribute("label"));
+		EXPECT_TRUE(face->GetExtraAttributes().empty());
+
+		InferObject single;
+		single.SetBBox(InferBoundingBox{ 0, 0, 1, 1 });
+		EXPECT_FLOAT_EQ(single.GetBBox().h, 1.f);
+		EXPECT_TRUE(single.AddExtraAttribute("label", "cat"));
+		EXPECT_EQ(single.GetExtraAttribute("label"), "cat");
+	}
+}  // namespace easysa
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "easysa_infer_table.hpp"
+
+namespace easysa {
+	TEST(CoreInferTable, ObjectsAndResults) {
+		InferObjTable table;
+		size_t row = table.AddObject(InferBoundingBox{ 0.1f, 0.2f, 0.3f, 0.4f }, 0.9f, 2);
+		EXPECT_EQ(table.Size(), 1u);
+		EXPECT_FLOAT_EQ(table.GetBBox(row).w, 0.3f);
+		EXPECT_EQ(table.GetClassId(row), 2);
+		EXPECT_EQ(table.GetTrackId(row), -1);
+
+		int pose = InferKeys::Intern("face_pose");
+		EXPECT_EQ(InferKeys::Intern("face_pose"), pose);
+		EXPECT_EQ(InferKeys::Name(pose), "face_pose");
+		EXPECT_TRUE(table.AddExtraAttribute(row, pose, "1"));
+		EXPECT_FALSE(table.AddExtraAttribute(row, "face_pose", "2"));
+		EXPECT_EQ(table.GetExtraAttribute(row, "face_pose"), "1");
+
+		EXPECT_TRUE(table.AddFeature(row, "face_pts", InferFeature{ 1.f, 2.f, 3.f }));
+		EXPECT_EQ(table.GetFeature(row, "face_pts"), (InferFeature{ 1.f, 2.f, 3.f }));
+		EXPECT_TRUE(table.GetFeature(row, "not_a_feature").empty());
+		EXPECT_FALSE(table.AddFeature(row + 1, "face_pts", InferFeature{ 1.f }));
+
+		FeatureSpan span = table.GetFeatureSpan(row, "face_pts");
+		ASSERT_EQ(span.size(), 3u);
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(span.data()) % FeatureArena::kAlignment, 0u);
+		EXPECT_FLOAT_EQ(span[2], 3.f);
+		EXPECT_EQ(span.ToVector(), table.GetFeature(row, "face_pts"));
+
+		table.Clear();
+		EXPECT_EQ(table.Size(), 0u);
+	}
+
+	TEST(CoreInferTable, EntriesPerRow) {
+		InferObjTable table;
+		int label = InferKeys::Intern("label");
+		int color = InferKeys::Intern("color");
+		size_t first = table.AddObject(InferBoundingBox{ 0, 0, 1, 1 }, 0.5f);
+		size_t second = table.AddObject(InferBoundingBox{ 0, 0, 1, 1 }, 0.6f);
+		EXPECT_TRUE(table.AddExtraAttribute(first, label, "cat"));
+		EXPECT_TRUE(table.AddExtraAttribute(second, label, "dog"));
+		EXPECT_TRUE(table.AddExtraAttribute(first, color, "black"));
+		EXPECT_EQ(table.GetExtraAttribute(first, label), "cat");
+		EXPECT_EQ(table.GetExtraAttribute(second, label), "dog");
+		EXPECT_TRUE(table.GetExtraAttribute(second, color).empty());
+
+		auto extras = table.GetExtraAttributes(first);
+		ASSERT_EQ(extras.size(), 2u);
+		EXPECT_EQ(extras[0], std::make_pair(label, std::string("cat")));
+		EXPECT_EQ(extras[1], std::make_pair(color, std::string("black")));
+
+		EXPECT_TRUE(table.RemoveExtraAttribute(first, label));
+		EXPECT_FALSE(table.RemoveExtraAttribute(first, label));
+		EXPECT_TRUE(table.GetExtraAttribute(first, label).empty());
+		EXPECT_EQ(table.GetExtraAttribute(second, label), "dog");
+		EXPECT_TRUE(table.AddExtraAttribute(first, label, "lion"));
+		extras = table.GetExtraAttributes(first);
+		ASSERT_EQ(extras.size(), 2u);
+		EXPECT_EQ(extras[0].second, "black");
+		EXPECT_EQ(extras[1].second, "lion");
+
+		EXPECT_TRUE(table.AddFeature(second, "a", InferFeature{ 1.f }));
+		EXPECT_TRUE(table.AddFeature(second, "b", InferFeature{ 2.f, 3.f }));
+		auto spans = table.GetFeatureSpans(second);
+		ASSERT_EQ(spans.size(), 2u);
+		EXPECT_EQ(spans[0].first, InferKeys::Find("a"));
+		EXPECT_EQ(spans[1].second.size(), 2u);
+		EXPECT_TRUE(table.GetFeatureSpans(first).empty());
+
+		table.Clear();
+		size_t row = table.AddObject(InferBoundingBox{ 0, 0, 1, 1 }, 0.7f);
+		EXPECT_TRUE(table.GetExtraAttributes(row).empty());
+		EXPECT_TRUE(table.GetFeatureSpans(row).empty());
+	}
+
+	TEST(CoreInferTable, ArenaAlignment) {
+		FeatureArena arena;
+		for (size_t size = 1; size < 3 * FeatureArena::kBlockFloats; size += 997) {
+			float* data = arena.Allocate(size);
+			ASSERT_NE(data, nullptr);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % FeatureArena::kAlignment, 0u);
+		}
+	}
+}  // namespace easysa
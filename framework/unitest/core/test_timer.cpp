@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/easysa_frame_pacer.hpp"
+#include "util/easysa_timer.hpp"
+
+namespace easysa {
+	using timer_id = TimerWheel::timer_id;
+	using timestamp = TimerWheel::timestamp;
+	using clock = TimerWheel::clock;
+
+	TEST(CoreTimer, OneShot) {
+		TimerWheel timer;
+		std::promise<timestamp> fired;
+		timestamp when = clock::now() + std::chrono::milliseconds(20);
+		timer.add(when, [&](timer_id) { fired.set_value(clock::now()); });
+		auto future = fired.get_future();
+		ASSERT_EQ(future.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+		EXPECT_GE(future.get(), when);
+	}
+
+	TEST(CoreTimer, Remove) {
+		TimerWheel timer;
+		std::atomic<int> count{ 0 };
+		timer_id id = timer.add(std::chrono::milliseconds(20), [&](timer_id) { ++count; });
+		EXPECT_TRUE(timer.remove(id));
+		EXPECT_FALSE(timer.remove(id));
+		std::this_thread::sleep_for(std::chrono::milliseconds(60));
+		EXPECT_EQ(count.load(), 0);
+	}
+
+	TEST(CoreTimer, RemoveExpired) {
+		TimerWheel timer;  // one worker, blocked below so expired timeouts wait for it
+		std::promise<void> blocked;
+		std::promise<void> release;
+		std::shared_future<void> released = release.get_future().share();
+		timer.add(std::chrono::milliseconds(1), [&](timer_id) {
+			blocked.set_value();
+			released.wait();
+		});
+		blocked.get_future().wait();
+
+		std::atomic<int> one_shot{ 0 };
+		std::atomic<int> periodic{ 0 };
+		std::atomic<int> reused{ 0 };
+		timer_id id = timer.add(std::chrono::milliseconds(1), [&](timer_id) { ++one_shot; });
+		timer_id periodic_id = timer.add(std::chrono::milliseconds(1), [&](timer_id) { ++periodic; },
+			std::chrono::milliseconds(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));  // both expired and queued
+		EXPECT_TRUE(timer.remove(id));
+		EXPECT_TRUE(timer.remove(periodic_id));
+		// the id of the periodic timeout is free at once, the queued runs must not reach the new handler
+		timer_id new_id = timer.add(std::chrono::seconds(10), [&](timer_id) { ++reused; });
+		EXPECT_EQ(new_id, periodic_id);
+
+		release.set_value();
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		EXPECT_EQ(one_shot.load(), 0);
+		EXPECT_EQ(periodic.load(), 0);
+		EXPECT_EQ(reused.load(), 0);
+		EXPECT_TRUE(timer.remove(new_id));
+	}
+
+	TEST(CoreTimer, Periodic) {
+		TimerWheel timer;
+		std::atomic<int> count{ 0 };
+		timer_id id = timer.add(std::chrono::milliseconds(5), [&](timer_id) { ++count; }, std::chrono::milliseconds(5));
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		timer.remove(id);
+		int fired = count.load();
+		EXPECT_GE(fired, 20);
+		EXPECT_LE(fired, 45);
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		EXPECT_LE(count.load(), fired + 1);  // at most the one already dispatched
+	}
+
+	TEST(CoreTimer, ManyTimersAcrossLevels) {
+		TimerWheel timer(4);
+		constexpr int kTimers = 2000;
+		std::atomic<int> count{ 0 };
+		std::vector<timer_id> removed;
+		for (int i = 0; i < kTimers; ++i) {
+			// up to 600 ms, beyond the lowest level of 256 ticks
+			timer_id id = timer.add(std::chrono::microseconds(300 * i), [&](timer_id) { ++count; });
+			if (i % 10 == 0) removed.push_back(id);
+		}
+		for (auto id : removed) {
+			EXPECT_TRUE(timer.remove(id));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(900));
+		EXPECT_EQ(count.load(), kTimers - static_cast<int>(removed.size()));
+	}
+
+	TEST(CoreTimer, PacedStreamsLateness) {
+		// 300 streams at 25 fps re-arm their next frame from the handler, as the decode scheduler does
+		constexpr int kStreams = 300;
+		std::mutex mutex;
+		std::vector<double> lateness;
+		std::atomic<bool> running{ true };
+		std::vector<std::unique_ptr<FramePacer>> pacers;
+		TimerWheel timer(2, std::chrono::microseconds(20));  // destroyed first, no handler outlives the state
+		std::function<void(FramePacer*, timestamp)> arm = [&](FramePacer* pacer, timestamp due) {
+			timer.add(due, [&, pacer, due](timer_id) {
+				double late = std::chrono::duration<double, std::micro>(clock::now() - due).count();
+				{
+					std::lock_guard<std::mutex> lk(mutex);
+					lateness.push_back(late);
+				}
+				if (running.load()) arm(pacer, pacer->NextDeadline());
+			});
+		};
+		for (int i = 0; i < kStreams; ++i) {
+			pacers.emplace_back(new FramePacer(25));
+			pacers.back()->Start();
+			arm(pacers.back().get(), pacers.back()->NextDeadline());
+			std::this_thread::sleep_for(std::chrono::microseconds(40000 / kStreams));  // streams start apart
+		}
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		running.store(false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));  // the last frames are not re-armed
+
+		std::lock_guard<std::mutex> lk(mutex);
+		ASSERT_GE(lateness.size(), static_cast<size_t>(kStreams * 25));
+		std::sort(lateness.begin(), lateness.end());
+		EXPECT_GE(lateness.front(), 0);  // never early
+		EXPECT_LT(lateness[lateness.size() * 99 / 100], 1000);
+	}
+}  // namespace easysa
@@ -61,8 +61,8 @@ void SentimentAnalysis::ProvideSource() {
 	auto& connector = it->second;
 	size_t conveyor_idx = std::stoi(stream_id_) % connector->connector_->GetConveyorCount();
 	cv::Mat src;
+	frame_controller_->Start();
 	while (running_) {
-		frame_controller_->Start();
 		auto data = easysa::FrameInfo::Create(stream_id_,false);
 		auto frame = std::make_shared<easysa::DataFrame>();
 		frame->skip_status = fsc_->GetSkipVectorNow();
@@ -131,12 +131,8 @@ void SentimentAnalysis::DetectModule() {
 		detect_info = rf_->detect(img_rsz, 0.9, 1.0);
 		for (auto& it : detect_info) {
 			std::vector<float> face_pts;
-			auto obj = std::make_shared<easysa::InferObject>();
-			obj->bbox.x = it.rect.x1;
-			obj->bbox.y = it.rect.y1;
-			obj->bbox.w = it.rect.x2 - it.rect.x1;
-			obj->bbox.h = it.rect.y2 - it.rect.y1;
-			obj->score = it.score;
+			auto obj = objs_ptr->AddObject(easysa::InferBoundingBox{ it.rect.x1, it.rect.y1,
+				it.rect.x2 - it.rect.x1, it.rect.y2 - it.rect.y1 }, it.score);
 			if (it.rect.x1 < 0 && it.rect.x1 > 1) continue;
 			if (it.rect.x2 < 0 && it.rect.x2 > 1) continue;
 			if (it.rect.y1 < 0 && it.rect.y1 > 1) continue;
@@ -153,7 +149,6 @@ void SentimentAnalysis::DetectModule() {
 			int label = PredictFacePose(it);
 			obj->AddExtraAttribute("face_pose", std::to_string(label));
 			obj->AddExtraAttribute("scaler_ratio", std::to_string(it.scale_ratio));
-			objs_ptr->objs_.push_back(obj);
 		}
 		while (running_ &&
 			next_connector->connector_->PushDataBufferToConveyor(conveyor_idx, data) == false) {
@@ -201,12 +196,13 @@ void SentimentAnalysis::FerModule() {
 			int width = src.cols;
 			int height = src.rows;
 			for (auto& it : objs_ptr->objs_) {
+				easysa::InferBoundingBox bbox = it->GetBBox();
 				float x1, y1, w, h, scale_ratio;
 				scale_ratio = std::stoi(it->GetExtraAttribute("scaler_ratio"));
-				x1 = it->bbox.x * scale_ratio * (1.0 * width / rz.width);
-				y1 = it->bbox.y * scale_ratio * (1.0 * height / rz.height);
-				w = it->bbox.w * scale_ratio * (1.0 * width / rz.width);
-				h = it->bbox.h * scale_ratio * (1.0 * height / rz.height);
+				x1 = bbox.x * scale_ratio * (1.0 * width / rz.width);
+				y1 = bbox.y * scale_ratio * (1.0 * height / rz.height);
+				w = bbox.w * scale_ratio * (1.0 * width / rz.width);
+				h = bbox.h * scale_ratio * (1.0 * height / rz.height);
 				//cv::Mat roi = src(cv::Rect(x1, y1, w, h));
 				cv::Mat* roi = new cv::Mat(src, cv::Rect(x1, y1, w, h));
 				fer_model_->PushMatToPool(roi);
@@ -267,18 +263,19 @@ void  SentimentAnalysis::EtvhModule() {
 			float x1, y1, w, h, scale_ratio;
 			scale_ratio = 2;
 			for (auto& it : objs_ptr->objs_) {
+				easysa::InferBoundingBox bbox = it->GetBBox();
 				w = scale_ratio * (1.0 * width / rz.width);
 				h = scale_ratio * (1.0 * height / rz.height);
-				x1 = it->bbox.x * w;
-				y1 = it->bbox.y * h;
-				w *= it->bbox.w;
-				h *= it->bbox.h;
+				x1 = bbox.x * w;
+				y1 = bbox.y * h;
+				w *= bbox.w;
+				h *= bbox.h;
 				/*
 				scale_ratio = std::stoi(it->GetExtraAttribute("scaler_ratio"));
-				x1 = it->bbox.x * scale_ratio * (1.0 * width / rz.width);
-				y1 = it->bbox.y * scale_ratio * (1.0 * height / rz.height);
-				w = it->bbox.w * scale_ratio * (1.0 * width / rz.width);
-				h = it->bbox.h * scale_ratio * (1.0 * height / rz.height);
+				x1 = bbox.x * scale_ratio * (1.0 * width / rz.width);
+				y1 = bbox.y * scale_ratio * (1.0 * height / rz.height);
+				w = bbox.w * scale_ratio * (1.0 * width / rz.width);
+				h = bbox.h * scale_ratio * (1.0 * height / rz.height);
 				*/
 				cv::Point left_up_core, right_bottom_core;
 				/*
@@ -287,10 +284,10 @@ void  SentimentAnalysis::EtvhModule() {
 				*/
 				std::vector<float> pts = it->GetFeature("face_pts");// pts: x0,x1,x2,x3,x4,y0,y1,y2,y3,y4
 				if (pts.size() == 0) continue;
-				left_up_core.y = (1.0 * height / rz.height) * scale_ratio * (it->bbox.y + pts[5]) * (1.0 / 2.0);
+				left_up_core.y = (1.0 * height / rz.height) * scale_ratio * (bbox.y + pts[5]) * (1.0 / 2.0);
 				right_bottom_core.y = (1.0 * height / rz.height) * scale_ratio * (pts[5] + (pts[7] - pts[5]) * ( 1.0 / 2.0));
-				left_up_core.x = (1.0 * width / rz.width) * scale_ratio * (it->bbox.x + pts[0]) * (1.0 / 2.0);
-				right_bottom_core.x = (1.0 * width / rz.width) * scale_ratio * (pts[1] + it->bbox.x + it->bbox.w) * (1.0 / 2.0);
+				left_up_core.x = (1.0 * width / rz.width) * scale_ratio * (bbox.x + pts[0]) * (1.0 / 2.0);
+				right_bottom_core.x = (1.0 * width / rz.width) * scale_ratio * (pts[1] + bbox.x + bbox.w) * (1.0 / 2.0);
 				//cv::Mat roi = src(cv::Rect(left_up_core, right_bottom_core));
 				//cv::imwrite("../../../data/images/output/face.jpg", roi);
 				cv::Mat* roi = new Mat(src, cv::Rect(left_up_core, right_bottom_core));
@@ -320,16 +317,17 @@ void  SentimentAnalysis::EtvhModule() {
 void SentimentAnalysis::DrawByObj(cv::Mat& src, std::shared_ptr<easysa::InferObject> obj,
 									bool skip_fer, bool skip_etvh) {
 	float scale_ratio = std::stoi(obj->GetExtraAttribute("scaler_ratio"));
+	easysa::InferBoundingBox bbox = obj->GetBBox();
 	int width = src.cols;
 	int height = src.rows;
 	cv::Size rz(640, 640);
 	float x1, x2,y1, y2, w1, h1;
 	w1 = scale_ratio * (1.0 * width / rz.width);
 	h1 = scale_ratio * (1.0 * height / rz.height);
-	x1 = obj->bbox.x * w1;
-	y1 = obj->bbox.y * h1;
-	x2 = x1 + obj->bbox.w * w1;
-	y2 = y1 + obj->bbox.h * h1;
+	x1 = bbox.x * w1;
+	y1 = bbox.y * h1;
+	x2 = x1 + bbox.w * w1;
+	y2 = y1 + bbox.h * h1;
 	//clip
 	x1 = (x1 < width) ? x1 : width;
 	x2 = (x2 < width) ? x2 : width;
@@ -68,7 +68,7 @@ private:
 private:
 	int PredictFacePose(const FaceDetectInfo& info);
 	void DrawByObj(cv::Mat& src, std::shared_ptr<easysa::InferObject> obj);
-	std::string GetLabel(const std::vector<float>& result, LABEL_TYPE type);
+	std::string GetLabel(const easysa::FeatureSpan& result, LABEL_TYPE type);
 private:
 	std::string rtfm_ = "../../../data/models/retinaface";
 	std::string fer_cache_path_ = "../../../data/models/fer/fer.cache";
@@ -47,12 +47,18 @@ void SentimentAnalysis2::ProvideSource() {
 	auto& connector = it->second;
 	size_t conveyor_idx = std::stoi(stream_id_) % connector->connector_->GetConveyorCount();
 	cv::Mat src;
+	frame_controller_->Start();
 	while (running_) {
-		frame_controller_->Start();
 		auto data = easysa::FrameInfo::Create(stream_id_,false);
 		auto frame = std::make_shared<easysa::DataFrame>();
 		bool ret = capture.read(frame->src_mat);
 		if (!ret) break;
+		frame->fmt = easysa::PIXEL_FORMAT_BGR24;
+		frame->width = frame->src_mat.cols;
+		frame->height = frame->src_mat.rows;
+		frame->ptr_cpu[0] = frame->src_mat.data;
+		frame->stride[0] = static_cast<int>(frame->src_mat.step[0] / 3);
+		frame->ctx.dev_type = easysa::DevContext::DevType::CPU;
 		/*
 		bool ret = capture.read(src);
 		if (!ret) break;
@@ -110,22 +116,18 @@ void SentimentAnalysis2::DetectModule() {
 		// Process 
 		auto frame = easysa::GetDataFramePtr(data);
 		auto objs_ptr = easysa::GetInferObjsPtr(data);
-		cv::Mat img_rsz;
-		cv::resize(frame->src_mat, img_rsz, rz);
+		// shared with the other modules of the frame
+		cv::Mat* img_rsz = frame->GetScaledImage(rz.width, rz.height, easysa::PIXEL_FORMAT_BGR24, true);
 		detect_info.clear();
-		detect_info = rf_->detect(img_rsz, 0.9, 1.0);
+		if (img_rsz) detect_info = rf_->detect(*img_rsz, 0.9, 1.0);
 		for (auto& it : detect_info) {
 			std::vector<float> face_pts;
 			if (it.rect.x1 < 0 && it.rect.x1 > 1) continue;
 			if (it.rect.x2 < 0 && it.rect.x2 > 1) continue;
 			if (it.rect.y1 < 0 && it.rect.y1 > 1) continue;
 			if (it.rect.y2 < 0 && it.rect.y2 > 1) continue;
-			auto obj = std::make_shared<easysa::InferObject>();
-			obj->bbox.x = it.rect.x1;
-			obj->bbox.y = it.rect.y1;
-			obj->bbox.w = it.rect.x2 - it.rect.x1;
-			obj->bbox.h = it.rect.y2 - it.rect.y1;
-			obj->score = it.score;
+			auto obj = objs_ptr->AddObject(easysa::InferBoundingBox{ it.rect.x1, it.rect.y1,
+				it.rect.x2 - it.rect.x1, it.rect.y2 - it.rect.y1 }, it.score);
 			// put x first, put y next
 			// x0, x1, x2, x3, x4, y0, y1, y2, y3, y4
 			for (auto& pts : it.pts.x) {
@@ -138,7 +140,6 @@ void SentimentAnalysis2::DetectModule() {
 			int label = PredictFacePose(it);
 			obj->AddExtraAttribute("face_pose", std::to_string(label));
 			obj->AddExtraAttribute("scaler_ratio", std::to_string(it.scale_ratio));
-			objs_ptr->objs_.push_back(obj);
 		}
 		while (running_ &&
 			next_connector->connector_->PushDataBufferToConveyor(conveyor_idx, data) == false) {
@@ -183,6 +184,7 @@ void SentimentAnalysis2::FerEtvhModule() {
 		int width = src.cols;
 		int height = src.rows;
 		for (auto& it : objs_ptr->objs_) {
+			easysa::InferBoundingBox bbox = it->GetBBox();
 			/*
 			* to fer
 			*/
@@ -190,10 +192,10 @@ void SentimentAnalysis2::FerEtvhModule() {
 			scale_ratio = std::stoi(it->GetExtraAttribute("scaler_ratio"));
 			w = scale_ratio * (1.0 * width / rz.width);
 			h = scale_ratio * (1.0 * height / rz.height);
-			x1 = it->bbox.x * w;
-			y1 = it->bbox.y * h;
-			w *= it->bbox.w;
-			h *= it->bbox.h;
+			x1 = bbox.x * w;
+			y1 = bbox.y * h;
+			w *= bbox.w;
+			h *= bbox.h;
 			//cv::Mat roi = src(cv::Rect(x1, y1, w, h));
 			/*
 			* to etvh
@@ -203,12 +205,12 @@ void SentimentAnalysis2::FerEtvhModule() {
 			* ۵ͷȡмΪϵy1, ӵȡеΪy2
 			* ۵߽ȡеΪx1, ۵ұ߽Ϊx2
 			*/
-			std::vector<float> pts = it->GetFeature("face_pts");// pts: x0,x1,x2,x3,x4,y0,y1,y2,y3,y4
+			easysa::FeatureSpan pts = it->GetFeatureSpan("face_pts");// pts: x0,x1,x2,x3,x4,y0,y1,y2,y3,y4
 			if (pts.size() == 0) continue;
-			left_up_core.y = (1.0 * height / rz.height) * scale_ratio * (it->bbox.y + pts[5]) * (1.0 / 2.0);
+			left_up_core.y = (1.0 * height / rz.height) * scale_ratio * (bbox.y + pts[5]) * (1.0 / 2.0);
 			right_bottom_core.y = (1.0 * height / rz.height) * scale_ratio * (pts[5] + (pts[7] - pts[5]) * (1.0 / 2.0));
-			left_up_core.x = (1.0 * width / rz.width) * scale_ratio * (it->bbox.x + pts[0]) * (1.0 / 2.0);
-			right_bottom_core.x = (1.0 * width / rz.width) * scale_ratio * (pts[1] + it->bbox.x + it->bbox.w) * (1.0 / 2.0);
+			left_up_core.x = (1.0 * width / rz.width) * scale_ratio * (bbox.x + pts[0]) * (1.0 / 2.0);
+			right_bottom_core.x = (1.0 * width / rz.width) * scale_ratio * (pts[1] + bbox.x + bbox.w) * (1.0 / 2.0);
 			//cv::Mat roi = src(cv::Rect(left_up_core, right_bottom_core));
 			//cv::imwrite("../../../data/images/output/face.jpg", roi);
 			cv::Mat* roi_etvh = new Mat(src, cv::Rect(left_up_core, right_bottom_core));
@@ -234,22 +236,23 @@ void SentimentAnalysis2::FerEtvhModule() {
 
 void SentimentAnalysis2::DrawByObj(cv::Mat& src, std::shared_ptr<easysa::InferObject> obj) {
 	float scale_ratio = std::stoi(obj->GetExtraAttribute("scaler_ratio"));
+	easysa::InferBoundingBox bbox = obj->GetBBox();
 	int width = src.cols;
 	int height = src.rows;
 	cv::Size rz(640, 640);
 	float x1, x2,y1, y2, w1, h1;
 	w1 = scale_ratio * (1.0 * width / rz.width);
 	h1 = scale_ratio * (1.0 * height / rz.height);
-	x1 = obj->bbox.x * w1;
-	y1 = obj->bbox.y * h1;
-	x2 = x1 + obj->bbox.w * w1;
-	y2 = y1 + obj->bbox.h * h1;
+	x1 = bbox.x * w1;
+	y1 = bbox.y * h1;
+	x2 = x1 + bbox.w * w1;
+	y2 = y1 + bbox.h * h1;
 	cv::Point p1(x1, y1), p2(x2, y1), p3(x1, y2), p4(x2, y2);
 	cv::line(src, p1, p2, cv::Scalar(255, 255, 255), 1, cv::LineTypes::LINE_8);
 	cv::line(src, p1, p3, cv::Scalar(255, 255, 255), 1, cv::LineTypes::LINE_8);
 	cv::line(src, p2, p4, cv::Scalar(255, 255, 255), 1, cv::LineTypes::LINE_8);
 	cv::line(src, p3, p4, cv::Scalar(255, 255, 255), 1, cv::LineTypes::LINE_8);
-	std::vector<float> pts = obj->GetFeature("face_pts");
+	easysa::FeatureSpan pts = obj->GetFeatureSpan("face_pts");
 	for (size_t j = 0; j < 5; j++) {
 		//if (j < 2) continue;
 		cv::Point2f pt = cv::Point2f(pts[j] * w1,
@@ -257,9 +260,9 @@ void SentimentAnalysis2::DrawByObj(cv::Mat& src, std::shared_ptr<easysa::InferOb
 		cv::circle(src, pt, 1, Scalar(0, 255, 0), 2);
 	}
 	std::string face_pose = "face_pose:" + obj->GetExtraAttribute("face_pose");
-	std::vector<float> etv = obj->GetFeature("etv");
-	std::vector<float> eth = obj->GetFeature("eth");
-	std::vector<float> fer_result = obj->GetFeature("fer");
+	easysa::FeatureSpan etv = obj->GetFeatureSpan("etv");
+	easysa::FeatureSpan eth = obj->GetFeatureSpan("eth");
+	easysa::FeatureSpan fer_result = obj->GetFeatureSpan("fer");
 	std::string v_direction = "V:" + GetLabel(etv, LABEL_TYPE::V_TYPE);
 	std::string h_direction = "H:" + GetLabel(eth, LABEL_TYPE::H_TYPE);
 	std::string fer_s = "fer:" + GetLabel(fer_result, LABEL_TYPE::FER);
@@ -273,7 +276,7 @@ void SentimentAnalysis2::DrawByObj(cv::Mat& src, std::shared_ptr<easysa::InferOb
 	cv::putText(src, fer_s, cv::Point(x1, y1 + 40), 1, FONT_HERSHEY_PLAIN,
 		Scalar(0, 255, 255), 1, LINE_8);
 }
-std::string SentimentAnalysis2::GetLabel(const std::vector<float>& result, LABEL_TYPE type) {
+std::string SentimentAnalysis2::GetLabel(const easysa::FeatureSpan& result, LABEL_TYPE type) {
 	/*
 	assert(result.size() > 0);
 	switch (type)